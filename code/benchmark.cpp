@@ -0,0 +1,524 @@
+// Benchmark suite for the hot paths of all demos. The demo sources are
+// compiled into this program with their main functions renamed, so each
+// of them still builds and runs on its own.
+//
+// Build: g++ -std=c++17 -O2 benchmark.cpp -o benchmark -pthread
+// Run:   benchmark [--filter=text] [--repetitions=N] [--warmup=N] [--perf]
+//                  [--json=result.json] [--compare=baseline.json] [--tolerance=0.1]
+//
+// --perf adds hardware counters (Linux perf_event_open), --compare reads
+// a JSON file of an earlier run and fails when a median got slower than
+// the tolerance allows.
+
+#define main wav_file_main
+#include "wav_file.cpp"
+#undef main
+#define main tictactoe_main
+#include "tictactoe.cpp"
+#undef main
+#define main stl_algorithms_main
+#include "../documented/STL algorithms.cpp"
+#undef main
+#define main memory_management_main
+#include "../documented/Memory management.cpp"
+#undef main
+
+#include <cstdio>
+#include <sstream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+// Keeps value alive, so the compiler can't drop the benchmarked code
+template <class T>
+inline void keep(const T &value)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &value;
+#endif
+}
+
+// Hardware counters of the calling thread, opened as one group so
+// all of them count over exactly the same time
+class PerfCounters
+{
+public:
+    static const int count = 4;
+
+    static const char *name(int i)
+    {
+        static const char *names[count] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+        return names[i];
+    }
+
+    PerfCounters()
+    {
+        for (int i = 0; i < count; i++)
+            fds[i] = -1;
+#ifdef __linux__
+        const uint64_t configs[count] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                         PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int i = 0; i < count; i++)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+            if (fds[i] < 0)
+            {
+                close_all();
+                return;
+            }
+        }
+#endif
+    }
+
+    ~PerfCounters()
+    {
+        close_all();
+    }
+
+    bool available() const
+    {
+        return fds[0] >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    // Stops counting and reads the counts since start()
+    void stop(double values[count])
+    {
+        for (int i = 0; i < count; i++)
+            values[i] = 0;
+#ifdef __linux__
+        ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t data[1 + count];
+        if (read(fds[0], data, sizeof(data)) == (ssize_t)sizeof(data))
+            for (int i = 0; i < count; i++)
+                values[i] = (double)data[1 + i];
+#endif
+    }
+
+private:
+    int fds[count];
+
+    void close_all()
+    {
+#ifdef __linux__
+        for (int i = count - 1; i >= 0; i--)
+            if (fds[i] >= 0)
+                ::close(fds[i]);
+#endif
+        for (int i = 0; i < count; i++)
+            fds[i] = -1;
+    }
+};
+
+struct BenchResult
+{
+    std::string name;
+    size_t samples;                       // timed samples, warmup not included
+    size_t batch;                         // calls per sample
+    double median_ns;                     // all times are per call
+    double p99_ns;
+    double min_ns;
+    double mean_ns;
+    bool has_counters;
+    double counters[PerfCounters::count]; // per call, median over samples
+};
+
+// Runs benchmarks: every benchmark gets warmup samples and then timed
+// samples; a sample is a batch of calls long enough to be timed well
+class BenchSuite
+{
+public:
+    // body(calls) runs the measured operation calls times
+    typedef std::function<void(size_t calls)> Body;
+
+    BenchSuite(size_t repetitions, size_t warmup, bool use_counters, const std::string &filter)
+        : repetitions(repetitions), warmup(warmup), filter(filter)
+    {
+        if (use_counters)
+        {
+            counters.reset(new PerfCounters());
+            if (!counters->available())
+            {
+                std::cerr << "perf_event_open is not available, hardware counters are off" << std::endl;
+                counters.reset();
+            }
+        }
+    }
+
+    // setup runs before every sample outside of the timed region, then
+    // the sample is a single call (for operations that change their data)
+    void run(const std::string &name, const Body &body, const std::function<void()> &setup = nullptr)
+    {
+        if (!filter.empty() && name.find(filter) == std::string::npos)
+            return;
+
+        size_t batch = 1;
+        if (!setup)
+        {
+            // grow batch until one sample takes at least 200 us
+            while (batch < (1u << 30) && time_ns(body, batch) < 200e3)
+                batch *= 2;
+        }
+
+        std::vector<double> times;
+        std::vector<std::vector<double>> counts(PerfCounters::count);
+        for (size_t i = 0; i < warmup + repetitions; i++)
+        {
+            if (setup)
+                setup();
+            double values[PerfCounters::count];
+            if (counters)
+                counters->start();
+            double ns = time_ns(body, batch);
+            if (counters)
+                counters->stop(values);
+            if (i < warmup)
+                continue;
+            times.push_back(ns / batch);
+            for (int c = 0; counters && c < PerfCounters::count; c++)
+                counts[c].push_back(values[c] / batch);
+        }
+
+        BenchResult result;
+        result.name = name;
+        result.samples = times.size();
+        result.batch = batch;
+        result.median_ns = percentile(times, 0.5);
+        result.p99_ns = percentile(times, 0.99);
+        result.min_ns = *std::min_element(times.begin(), times.end());
+        double sum = 0;
+        for (double t : times)
+            sum += t;
+        result.mean_ns = sum / times.size();
+        result.has_counters = (bool)counters;
+        for (int c = 0; c < PerfCounters::count; c++)
+            result.counters[c] = counters ? percentile(counts[c], 0.5) : 0;
+        results.push_back(result);
+        print_row(std::cout, result);
+    }
+
+    const std::vector<BenchResult> &get_results() const
+    {
+        return results;
+    }
+
+    static void print_row(std::ostream &out, const BenchResult &r)
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "%-36s median %12.1f ns  p99 %12.1f ns  min %12.1f ns", r.name.c_str(),
+                 r.median_ns, r.p99_ns, r.min_ns);
+        out << line;
+        if (r.has_counters)
+            out << "  " << r.counters[0] << " cycles, " << r.counters[1] << " instructions";
+        out << std::endl;
+    }
+
+    // One benchmark per line, so files of two runs are easy to diff
+    void write_json(const std::string &path) const
+    {
+        std::ofstream out(path);
+        if (!out)
+            throw std::runtime_error("Cannot open " + path);
+        out.precision(10);
+        out << "{\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const BenchResult &r = results[i];
+            out << "    {\"name\": \"" << r.name << "\", \"samples\": " << r.samples << ", \"batch\": " << r.batch
+                << ", \"median_ns\": " << r.median_ns << ", \"p99_ns\": " << r.p99_ns << ", \"min_ns\": " << r.min_ns
+                << ", \"mean_ns\": " << r.mean_ns;
+            for (int c = 0; r.has_counters && c < PerfCounters::count; c++)
+                out << ", \"" << PerfCounters::name(c) << "\": " << r.counters[c];
+            out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+    // Compares medians with a file from write_json, returns the number of
+    // benchmarks that got slower by more than tolerance (0.1 = 10 %)
+    size_t compare(const std::string &path, double tolerance) const
+    {
+        std::ifstream in(path);
+        if (!in)
+            throw std::runtime_error("Cannot open " + path);
+        size_t regressions = 0;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::string name = json_string(line, "name");
+            double baseline = json_number(line, "median_ns");
+            for (const BenchResult &r : results)
+            {
+                if (r.name != name || baseline <= 0)
+                    continue;
+                double change = r.median_ns / baseline - 1;
+                bool slower = change > tolerance;
+                regressions += slower;
+                char row[256];
+                snprintf(row, sizeof(row), "%-36s %12.1f -> %12.1f ns  %+6.1f %%%s", name.c_str(), baseline,
+                         r.median_ns, change * 100, slower ? "  REGRESSION" : "");
+                std::cout << row << std::endl;
+            }
+        }
+        return regressions;
+    }
+
+private:
+    size_t repetitions;
+    size_t warmup;
+    std::string filter;
+    std::unique_ptr<PerfCounters> counters;
+    std::vector<BenchResult> results;
+
+    static double time_ns(const Body &body, size_t calls)
+    {
+        auto start = std::chrono::steady_clock::now();
+        body(calls);
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+            return 0;
+        std::sort(values.begin(), values.end());
+        size_t index = (size_t)std::ceil(p * values.size());
+        return values[index > 0 ? index - 1 : 0];
+    }
+
+    static std::string json_string(const std::string &line, const std::string &key)
+    {
+        size_t pos = line.find("\"" + key + "\": \"");
+        if (pos == std::string::npos)
+            return "";
+        pos += key.size() + 5;
+        return line.substr(pos, line.find('"', pos) - pos);
+    }
+
+    static double json_number(const std::string &line, const std::string &key)
+    {
+        size_t pos = line.find("\"" + key + "\": ");
+        if (pos == std::string::npos)
+            return 0;
+        return atof(line.c_str() + pos + key.size() + 4);
+    }
+};
+
+// The calls of test_algorithms() on 64K random ints
+void benchmark_stl(BenchSuite &suite)
+{
+    const size_t n = 1 << 16;
+    const vector<int> data = random_vector(n, 1);
+    vector<int> sorted = data;
+    sort(sorted.begin(), sorted.end());
+    vector<int> v, out(2 * n);
+    auto reset = [&] { v = data; };
+    auto reset_halves = [&] {
+        v = data;
+        sort(v.begin(), v.begin() + n / 2);
+        sort(v.begin() + n / 2, v.end());
+    };
+
+    suite.run("stl/reverse", [&](size_t) { reverse(v.begin(), v.end()); keep(v[0]); }, reset);
+    suite.run("stl/rotate", [&](size_t) { rotate(v.begin(), v.begin() + 3, v.end()); keep(v[0]); }, reset);
+    suite.run("stl/sort", [&](size_t) { sort(v.begin(), v.end()); keep(v[0]); }, reset);
+    suite.run("stl/stable_sort", [&](size_t) { stable_sort(v.begin(), v.end()); keep(v[0]); }, reset);
+    suite.run("stl/partial_sort", [&](size_t) { partial_sort(v.begin(), v.begin() + n / 100, v.end()); keep(v[0]); },
+              reset);
+    suite.run("stl/nth_element", [&](size_t) { nth_element(v.begin(), v.begin() + n / 2, v.end()); keep(v[0]); },
+              reset);
+    suite.run("stl/merge", [&](size_t) {
+        merge(v.begin(), v.begin() + n / 2, v.begin() + n / 2, v.end(), out.begin());
+        keep(out[0]);
+    }, reset_halves);
+    suite.run("stl/inplace_merge", [&](size_t) {
+        inplace_merge(v.begin(), v.begin() + n / 2, v.end());
+        keep(v[0]);
+    }, reset_halves);
+    suite.run("stl/includes", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+            keep(includes(sorted.begin(), sorted.end(), sorted.begin() + n / 4, sorted.begin() + n / 2));
+    });
+    suite.run("stl/set_union", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+            keep(set_union(sorted.begin(), sorted.begin() + n / 2, sorted.begin() + n / 4, sorted.end(), out.begin()));
+    });
+
+    // searches: one call is one query, queries walk through data
+    size_t q = 0;
+    auto query = [&] { return data[q++ & (n - 1)]; };
+    suite.run("stl/lower_bound", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+            keep(lower_bound(sorted.begin(), sorted.end(), query()));
+    });
+    suite.run("stl/upper_bound", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+            keep(upper_bound(sorted.begin(), sorted.end(), query()));
+    });
+    suite.run("stl/binary_search", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+            keep(binary_search(sorted.begin(), sorted.end(), query()));
+    });
+    suite.run("stl/equal_range", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+            keep(equal_range(sorted.begin(), sorted.end(), query()));
+    });
+}
+
+// One second of 44.1 kHz mono sine: generation and saving
+void benchmark_wav(BenchSuite &suite)
+{
+    const char *path = "benchmark.wav";
+    std::unique_ptr<WavFile> file;
+    // save() reports progress on cout, the output is dropped while timing
+    std::ostringstream dropped;
+    std::streambuf *console = std::cout.rdbuf();
+
+    suite.run("wav/generate_sin", [&](size_t) { file->generate_sin(440, 0.5, 1); },
+              [&] { file.reset(new WavFile(path, 44100, 1, 16)); });
+    suite.run("wav/save", [&](size_t) {
+        std::cout.rdbuf(dropped.rdbuf());
+        file->save();
+        std::cout.rdbuf(console);
+        dropped.str("");
+    }, [&] {
+        file.reset(new WavFile(path, 44100, 1, 16));
+        file->generate_sin(440, 0.5, 1);
+    });
+    file.reset();
+    std::remove(path);
+}
+
+// Win checks after the last move: 3x3 game, raw 3x3 and 15x15 boards, perfect play table
+void benchmark_tictactoe(BenchSuite &suite)
+{
+    TicTacToe<> game;
+    const int moves[5][2] = {{1, 1}, {0, 0}, {2, 2}, {0, 2}, {0, 1}};
+    for (const auto &move : moves)
+    {
+        game.set_value(move[0], move[1]);
+        game.next_player();
+    }
+    suite.run("tictactoe/check_winner", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+            keep(game.check_winner());
+    });
+
+    ClassicBoard board;
+    board.set(4, 'X');
+    board.set(0, 'O');
+    board.set(8, 'X');
+    suite.run("tictactoe/has_line_3x3", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+            keep(ClassicBoard::has_line(board.x) || ClassicBoard::has_line(board.o));
+    });
+
+    Board<15, 15, 5> gomoku;
+    for (int i = 0; i < 4; i++)
+        gomoku.set(7 * 15 + 5 + i, 'X');
+    suite.run("tictactoe/wins_with_15x15", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+            keep(Board<15, 15, 5>::wins_with(gomoku.x, 7 * 15 + 9));
+    });
+
+    // one call is one lookup, lookups walk through all legal positions
+    std::vector<std::pair<uint16_t, uint16_t>> positions;
+    for (uint16_t x = 0; x < 512; x++)
+        for (uint16_t o = 0; o < 512; o++)
+            if (perfect_play(x, o).value != 2)
+                positions.push_back({x, o});
+    size_t p = 0;
+    suite.run("tictactoe/perfect_play", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+        {
+            const auto &position = positions[p];
+            p = p + 1 < positions.size() ? p + 1 : 0;
+            keep(perfect_play(position.first, position.second).move);
+        }
+    });
+}
+
+// Copies and assignments share one counter, as in test_weak()
+void benchmark_weak_ptr(BenchSuite &suite)
+{
+    WeakPtr<int> source(new int(5));
+    WeakPtr<int> other(new int(6));
+    WeakPtr<int> target;
+
+    suite.run("weak_ptr/copy", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+        {
+            WeakPtr<int> copy(source);
+            keep(copy);
+        }
+    });
+    suite.run("weak_ptr/assign", [&](size_t calls) {
+        for (size_t i = 0; i < calls; i++)
+        {
+            target = (i & 1) ? source : other;
+            keep(target);
+        }
+    });
+}
+
+int main(int argc, char **argv)
+{
+    size_t repetitions = 30;
+    size_t warmup = 3;
+    bool use_counters = false;
+    double tolerance = 0.1;
+    std::string filter, json_path, compare_path;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto value = [&](const char *key) { return arg.substr(strlen(key)); };
+        if (arg.rfind("--repetitions=", 0) == 0)
+            repetitions = std::max(1, atoi(value("--repetitions=").c_str()));
+        else if (arg.rfind("--warmup=", 0) == 0)
+            warmup = std::max(0, atoi(value("--warmup=").c_str()));
+        else if (arg == "--perf")
+            use_counters = true;
+        else if (arg.rfind("--filter=", 0) == 0)
+            filter = value("--filter=");
+        else if (arg.rfind("--json=", 0) == 0)
+            json_path = value("--json=");
+        else if (arg.rfind("--compare=", 0) == 0)
+            compare_path = value("--compare=");
+        else if (arg.rfind("--tolerance=", 0) == 0)
+            tolerance = atof(value("--tolerance=").c_str());
+    }
+
+    BenchSuite suite(repetitions, warmup, use_counters, filter);
+    benchmark_stl(suite);
+    benchmark_wav(suite);
+    benchmark_tictactoe(suite);
+    benchmark_weak_ptr(suite);
+
+    if (!json_path.empty())
+        suite.write_json(json_path);
+    if (!compare_path.empty() && suite.compare(compare_path, tolerance) > 0)
+        return 1;
+    return 0;
+}
@@ -1,26 +1,1381 @@
 #include<iostream>
+#include<algorithm>
+#include<array>
+#include<atomic>
+#include<cassert>
+#include<bitset>
+#include<chrono>
+#include<cmath>
+#include<condition_variable>
+#include<cstdint>
+#include<cstdlib>
+#include<cstring>
+#include<deque>
+#include<fstream>
+#include<functional>
+#include<memory>
+#include<mutex>
+#include<random>
+#include<stdexcept>
+#include<string>
+#include<thread>
+#include<vector>
 
+// Board of Rows x Cols squares as two compile-time-sized bitsets,
+// bit (row * Cols + col) is set when player has that square
+template <int Rows, int Cols, int WinLength>
+struct Board {
+    static constexpr int squares = Rows * Cols;
+    typedef std::bitset<squares> Mask;
+
+    // Number of winning lines (rows, columns and both diagonals)
+    static constexpr int line_count = Rows * (Cols - WinLength + 1) + (Rows - WinLength + 1) * Cols +
+                                      2 * (Rows - WinLength + 1) * (Cols - WinLength + 1);
+
+    // Window of WinLength squares: first square and step between squares
+    struct Window {
+        int16_t start;
+        int16_t step;
+    };
+
+    static constexpr std::array<Window, line_count> make_windows() {
+        std::array<Window, line_count> windows{};
+        const int directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        int count = 0;
+        for (const auto& d : directions) {
+            for (int row = 0; row < Rows; row++) {
+                for (int col = 0; col < Cols; col++) {
+                    int end_row = row + d[0] * (WinLength - 1);
+                    int end_col = col + d[1] * (WinLength - 1);
+                    if (end_row >= Rows || end_col < 0 || end_col >= Cols) {
+                        continue;
+                    }
+                    windows[count].start = (int16_t)(row * Cols + col);
+                    windows[count].step = (int16_t)(d[0] * Cols + d[1]);
+                    count++;
+                }
+            }
+        }
+        return windows;
+    }
+
+    // All winning lines as masks, only for boards that fit into 64 bits
+    static constexpr std::array<uint64_t, line_count> make_lines() {
+        std::array<uint64_t, line_count> lines{};
+        std::array<Window, line_count> windows = make_windows();
+        for (int i = 0; i < line_count; i++) {
+            for (int j = 0; j < WinLength; j++) {
+                lines[i] |= 1ULL << (windows[i].start + windows[i].step * j);
+            }
+        }
+        return lines;
+    }
+
+    Mask x;
+    Mask o;
+
+    Mask legal_moves() const { return ~(x | o); }
+
+    // Moves worth searching: all free squares on small boards, on big boards
+    // only squares next to a stone (the center on an empty board)
+    Mask candidate_moves() const {
+        if constexpr (squares <= 64) {
+            return legal_moves();
+        } else {
+            static const Mask not_first_col = all_but_column(0);
+            static const Mask not_last_col = all_but_column(Cols - 1);
+            Mask stones = x | o;
+            if (stones.none()) {
+                Mask center;
+                center[(Rows / 2) * Cols + Cols / 2] = true;
+                return center;
+            }
+            Mask near = stones | (stones << Cols) | (stones >> Cols);
+            near |= ((near << 1) & not_first_col) | ((near >> 1) & not_last_col);
+            return near & legal_moves();
+        }
+    }
+
+    static Mask all_but_column(int col) {
+        Mask mask;
+        mask.set();
+        for (int row = 0; row < Rows; row++) {
+            mask[row * Cols + col] = false;
+        }
+        return mask;
+    }
+    bool is_free(int square) const { return !x[square] && !o[square]; }
+    const Mask& mask(char player) const { return player == 'X' ? x : o; }
+
+    void set(int square, char player) {
+        if (player == 'X') {
+            x[square] = true;
+        } else {
+            o[square] = true;
+        }
+    }
+
+    void reset(int square) {
+        x[square] = false;
+        o[square] = false;
+    }
+
+    char at(int square, char empty) const {
+        if (x[square]) {
+            return 'X';
+        }
+        if (o[square]) {
+            return 'O';
+        }
+        return empty;
+    }
+
+    // Longest line of mask through square, counted as if square is taken
+    static int longest_run(const Mask& mask, int square) {
+        const int directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        int row = square / Cols;
+        int col = square % Cols;
+        int longest = 0;
+        for (const auto& d : directions) {
+            int count = 1;
+            for (int r = row + d[0], c = col + d[1]; r < Rows && c >= 0 && c < Cols && mask[r * Cols + c];
+                 r += d[0], c += d[1]) {
+                count++;
+            }
+            for (int r = row - d[0], c = col - d[1]; r >= 0 && c >= 0 && c < Cols && mask[r * Cols + c];
+                 r -= d[0], c -= d[1]) {
+                count++;
+            }
+            longest = std::max(longest, count);
+        }
+        return longest;
+    }
+
+    // Checks only lines going through square (the last move)
+    static bool wins_with(const Mask& mask, int square) { return longest_run(mask, square) >= WinLength; }
+
+    // Checks whole board, small boards are tested against precomputed line masks
+    static bool has_line(const Mask& mask) {
+        if constexpr (squares <= 64) {
+            static constexpr std::array<uint64_t, line_count> lines = make_lines();
+            uint64_t bits = mask.to_ullong();
+            for (uint64_t line : lines) {
+                if ((bits & line) == line) {
+                    return true;
+                }
+            }
+            return false;
+        } else {
+            for (int square = 0; square < squares; square++) {
+                if (mask[square] && wins_with(mask, square)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
+    // Calls visit(square) for every free square
+    template <typename Visit>
+    void for_each_move(Visit visit) const {
+        Mask moves = legal_moves();
+        if constexpr (squares <= 64) {
+            uint64_t bits = moves.to_ullong();
+            while (bits) {
+                visit(pop_lowest(bits));
+            }
+        } else {
+            for (int square = 0; square < squares; square++) {
+                if (moves[square]) {
+                    visit(square);
+                }
+            }
+        }
+    }
+
+    // Index of the lowest set bit, which is removed from bits
+    static int pop_lowest(uint64_t& bits) {
+#if defined(__GNUC__)
+        int square = __builtin_ctzll(bits);
+#else
+        int square = 0;
+        while (!(bits >> square & 1)) {
+            square++;
+        }
+#endif
+        bits &= bits - 1;
+        return square;
+    }
+};
+
+typedef Board<3, 3, 3> ClassicBoard;
+
+static_assert(ClassicBoard::line_count == 8, "3x3 board has 8 lines");
+static_assert(ClassicBoard::make_lines()[0] == 0x007 && ClassicBoard::make_lines()[7] == 0x054,
+              "win masks must cover rows and diagonals");
+
+// Computer player interface used by the game
+template <int Rows, int Cols, int WinLength>
+class Engine {
+    public:
+        virtual ~Engine() {}
+        // Best move (square index) for player, -1 when board is full
+        virtual int best_move(const Board<Rows, Cols, WinLength>& position, char player) = 0;
+        virtual void report(std::ostream& out) const = 0;
+};
+
+// Uniformly random legal move
+template <int Rows, int Cols, int WinLength>
+class RandomEngine : public Engine<Rows, Cols, WinLength> {
+    public:
+        explicit RandomEngine(uint64_t seed) : state(seed | 1) {}
+
+        int best_move(const Board<Rows, Cols, WinLength>& position, char) override {
+            int count = (int)position.legal_moves().count();
+            if (count == 0) {
+                return -1;
+            }
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            int pick = (int)((state >> 32) % count);
+            int move = -1;
+            position.for_each_move([&](int square) {
+                if (pick-- == 0) {
+                    move = square;
+                }
+            });
+            return move;
+        }
+
+        void report(std::ostream& out) const override { out << "random"; }
+
+    private:
+        uint64_t state;
+};
+
+// Position hash keys, two per square (X and O), fixed at compile time
+template <int Squares>
+constexpr std::array<uint64_t, 2 * Squares> make_zobrist_keys() {
+    std::array<uint64_t, 2 * Squares> keys{};
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < 2 * Squares; i++) {
+        state += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        keys[i] = z ^ (z >> 31);
+    }
+    return keys;
+}
+
+// 16 bytes, so four entries share one cache line
+struct TTEntry {
+    uint64_t key;
+    int32_t score;
+    int16_t move;
+    uint8_t depth;
+    uint8_t bound;
+};
+
+struct alignas(64) TTBucket {
+    TTEntry entries[4];
+};
+
+static_assert(sizeof(TTBucket) == 64, "bucket must fill exactly one cache line");
+
+class TranspositionTable {
+    public:
+        enum Bound : uint8_t { Empty, Exact, Lower, Upper };
+
+        // Bucket count is the largest power of two fitting into megabytes
+        explicit TranspositionTable(size_t megabytes) {
+            size_t count = 1;
+            while (count * 2 * sizeof(TTBucket) <= (megabytes << 20)) {
+                count *= 2;
+            }
+            buckets.resize(count);
+            mask = count - 1;
+        }
+
+        const TTEntry* probe(uint64_t key) const {
+            const TTBucket& bucket = buckets[key & mask];
+            for (const TTEntry& entry : bucket.entries) {
+                if (entry.bound != Empty && entry.key == key) {
+                    return &entry;
+                }
+            }
+            return nullptr;
+        }
+
+        // Same key or an empty slot is reused, otherwise the shallowest entry is replaced
+        void store(uint64_t key, int score, int move, int depth, Bound bound) {
+            TTBucket& bucket = buckets[key & mask];
+            TTEntry* replace = &bucket.entries[0];
+            for (TTEntry& entry : bucket.entries) {
+                if (entry.bound == Empty || entry.key == key) {
+                    replace = &entry;
+                    break;
+                }
+                if (entry.depth < replace->depth) {
+                    replace = &entry;
+                }
+            }
+            replace->key = key;
+            replace->score = score;
+            replace->move = (int16_t)move;
+            replace->depth = (uint8_t)std::min(depth, 255);
+            replace->bound = bound;
+        }
+
+        void clear() { std::fill(buckets.begin(), buckets.end(), TTBucket{}); }
+
+    private:
+        std::vector<TTBucket> buckets;
+        size_t mask;
+};
+
+// Negamax with alpha-beta pruning and iterative deepening until time budget is spent.
+// Positions are hashed in all board symmetries (8 for square boards, 4 otherwise),
+// the smallest hash is the table key, so mirrored positions share one entry.
+template <int Rows, int Cols, int WinLength>
+class AlphaBeta : public Engine<Rows, Cols, WinLength> {
+    public:
+        typedef Board<Rows, Cols, WinLength> BoardType;
+        typedef typename BoardType::Mask Mask;
+        static constexpr int squares = BoardType::squares;
+        static constexpr int symmetries = Rows == Cols ? 8 : 4;
+        static constexpr int win_score = 1000000;
+
+        AlphaBeta(TranspositionTable& table, std::chrono::milliseconds budget) : table(table), budget(budget) {}
+
+        // Search with its own table, e.g. one per self-play thread
+        AlphaBeta(size_t table_megabytes, std::chrono::milliseconds budget)
+            : owned_table(new TranspositionTable(table_megabytes)), table(*owned_table), budget(budget) {}
+
+        int best_move(const BoardType& position, char player) override {
+            board = position;
+            nodes = 0;
+            depth_reached = 0;
+            stopped = false;
+            deadline = std::chrono::steady_clock::now() + budget;
+            empties = (int)board.legal_moves().count();
+            for (int s = 0; s < symmetries; s++) {
+                hashes[s] = 0;
+            }
+            for (int square = 0; square < squares; square++) {
+                if (!board.is_free(square)) {
+                    toggle(square, board.x[square] ? 'X' : 'O');
+                }
+            }
+            if (empties == 0) {
+                return -1;
+            }
+
+            int best = -1;
+            for (int depth = 1; depth <= empties; depth++) {
+                root_move = -1;
+                int value = negamax(depth, -win_score, win_score, 0, player, -1);
+                if (stopped) {
+                    break;
+                }
+                best = root_move;
+                score = value;
+                depth_reached = depth;
+                if (std::abs(value) > win_score / 2) {
+                    break;
+                }
+            }
+            if (best < 0) {
+                int moves[squares];
+                order_moves(player, -1, moves);
+                best = moves[0];
+            }
+            return best;
+        }
+
+        void report(std::ostream& out) const override {
+            out << "depth " << depth_reached << ", score " << score << ", " << nodes << " nodes";
+        }
+
+        long long get_nodes() const { return nodes; }
+        int get_depth() const { return depth_reached; }
+        int get_score() const { return score; }
+
+    private:
+        static constexpr std::array<uint64_t, 2 * squares> keys = make_zobrist_keys<squares>();
+        static constexpr std::array<typename BoardType::Window, BoardType::line_count> windows =
+            BoardType::make_windows();
+
+        // symmetry_map[s][square] is square after symmetry s
+        static constexpr std::array<std::array<int16_t, squares>, symmetries> make_symmetry_map() {
+            std::array<std::array<int16_t, squares>, symmetries> map{};
+            for (int s = 0; s < symmetries; s++) {
+                for (int row = 0; row < Rows; row++) {
+                    for (int col = 0; col < Cols; col++) {
+                        int r = (s & 1) ? Rows - 1 - row : row;
+                        int c = (s & 2) ? Cols - 1 - col : col;
+                        map[s][row * Cols + col] = (int16_t)((s & 4) ? c * Cols + r : r * Cols + c);
+                    }
+                }
+            }
+            return map;
+        }
+
+        static constexpr std::array<std::array<int16_t, squares>, symmetries> make_inverse_map() {
+            std::array<std::array<int16_t, squares>, symmetries> map = make_symmetry_map();
+            std::array<std::array<int16_t, squares>, symmetries> inverse{};
+            for (int s = 0; s < symmetries; s++) {
+                for (int square = 0; square < squares; square++) {
+                    inverse[s][map[s][square]] = (int16_t)square;
+                }
+            }
+            return inverse;
+        }
+
+        static constexpr std::array<std::array<int16_t, squares>, symmetries> symmetry_map = make_symmetry_map();
+        static constexpr std::array<std::array<int16_t, squares>, symmetries> inverse_map = make_inverse_map();
+
+        std::unique_ptr<TranspositionTable> owned_table;
+        TranspositionTable& table;
+        std::chrono::milliseconds budget;
+        std::chrono::steady_clock::time_point deadline;
+        BoardType board;
+        uint64_t hashes[symmetries];
+        long long nodes = 0;
+        int empties = 0;
+        int root_move = -1;
+        int depth_reached = 0;
+        int score = 0;
+        bool stopped = false;
+
+        static char other(char player) { return player == 'X' ? 'O' : 'X'; }
+
+        void toggle(int square, char player) {
+            int offset = player == 'X' ? 0 : squares;
+            for (int s = 0; s < symmetries; s++) {
+                hashes[s] ^= keys[offset + symmetry_map[s][square]];
+            }
+        }
+
+        uint64_t canonical_key(int& symmetry) const {
+            symmetry = 0;
+            for (int s = 1; s < symmetries; s++) {
+                if (hashes[s] < hashes[symmetry]) {
+                    symmetry = s;
+                }
+            }
+            return hashes[symmetry];
+        }
+
+        // Scores of windows still open for one player, 4^stones each
+        int evaluate(char player) const {
+            const Mask& own = board.mask(player);
+            const Mask& opponent = board.mask(other(player));
+            int total = 0;
+            for (const auto& window : windows) {
+                int own_count = 0;
+                int opponent_count = 0;
+                for (int i = 0, square = window.start; i < WinLength; i++, square += window.step) {
+                    own_count += own[square];
+                    opponent_count += opponent[square];
+                }
+                if (opponent_count == 0 && own_count > 0) {
+                    total += 1 << (2 * own_count);
+                } else if (own_count == 0 && opponent_count > 0) {
+                    total -= 1 << (2 * opponent_count);
+                }
+            }
+            return std::max(-win_score / 4, std::min(win_score / 4, total));
+        }
+
+        // Candidate moves, best first:
+        // winning move, blocking move, then longest own and opponent lines
+        int order_moves(char player, int first, int* moves) const {
+            Mask candidates = board.candidate_moves();
+            const Mask& own = board.mask(player);
+            const Mask& opponent = board.mask(other(player));
+            int scores[squares];
+            int count = 0;
+            board.for_each_move([&](int square) {
+                if (!candidates[square]) {
+                    return;
+                }
+                int own_run = BoardType::longest_run(own, square);
+                int opponent_run = BoardType::longest_run(opponent, square);
+                int value = own_run * own_run * 4 + opponent_run * opponent_run * 3;
+                if (square == first) {
+                    value = 1 << 30;
+                } else if (own_run >= WinLength) {
+                    value = 1 << 29;
+                } else if (opponent_run >= WinLength) {
+                    value = 1 << 28;
+                }
+                int i = count++;
+                for (; i > 0 && scores[i - 1] < value; i--) {
+                    scores[i] = scores[i - 1];
+                    moves[i] = moves[i - 1];
+                }
+                scores[i] = value;
+                moves[i] = square;
+            });
+            return count;
+        }
+
+        // Mate scores are stored relative to the position, not to the root
+        static int to_table(int value, int ply) {
+            return value > win_score / 2 ? value + ply : (value < -win_score / 2 ? value - ply : value);
+        }
+
+        static int from_table(int value, int ply) {
+            return value > win_score / 2 ? value - ply : (value < -win_score / 2 ? value + ply : value);
+        }
+
+        int negamax(int depth, int alpha, int beta, int ply, char player, int last_move) {
+            if (last_move >= 0 && BoardType::wins_with(board.mask(other(player)), last_move)) {
+                return -(win_score - ply);
+            }
+            if (empties == 0) {
+                return 0;
+            }
+            if (depth == 0) {
+                return evaluate(player);
+            }
+            if ((++nodes & 1023) == 0 && std::chrono::steady_clock::now() > deadline) {
+                stopped = true;
+            }
+            if (stopped) {
+                return 0;
+            }
+
+            int symmetry;
+            uint64_t key = canonical_key(symmetry);
+            int table_move = -1;
+            const int alpha_start = alpha;
+            if (const TTEntry* entry = table.probe(key)) {
+                if (entry->move >= 0) {
+                    table_move = inverse_map[symmetry][entry->move];
+                }
+                if (entry->depth >= depth && ply > 0) {
+                    int value = from_table(entry->score, ply);
+                    if (entry->bound == TranspositionTable::Exact) {
+                        return value;
+                    }
+                    if (entry->bound == TranspositionTable::Lower) {
+                        alpha = std::max(alpha, value);
+                    } else {
+                        beta = std::min(beta, value);
+                    }
+                    if (alpha >= beta) {
+                        return value;
+                    }
+                }
+            }
+
+            int moves[squares];
+            int count = order_moves(player, table_move, moves);
+            int best = -win_score - 1;
+            int best_square = moves[0];
+            for (int i = 0; i < count; i++) {
+                int square = moves[i];
+                board.set(square, player);
+                toggle(square, player);
+                empties--;
+                int value = -negamax(depth - 1, -beta, -alpha, ply + 1, other(player), square);
+                empties++;
+                toggle(square, player);
+                board.reset(square);
+                if (stopped) {
+                    return 0;
+                }
+                if (value > best) {
+                    best = value;
+                    best_square = square;
+                    if (ply == 0) {
+                        root_move = square;
+                    }
+                }
+                alpha = std::max(alpha, value);
+                if (alpha >= beta) {
+                    break;
+                }
+            }
+
+            TranspositionTable::Bound bound = best <= alpha_start ? TranspositionTable::Upper
+                                              : best >= beta      ? TranspositionTable::Lower
+                                                                  : TranspositionTable::Exact;
+            table.store(key, to_table(best, ply), symmetry_map[symmetry][best_square], depth, bound);
+            return best;
+        }
+};
+
+// Work-stealing pool: every worker owns a deque, takes its own tasks from the back
+// and steals from the front of other deques. The caller of run() is worker 0.
+class WorkStealingPool {
+    public:
+        typedef std::function<void(int worker)> Task;
+
+        explicit WorkStealingPool(int threads = (int)std::max(1u, std::thread::hardware_concurrency())) {
+            for (int i = 0; i < threads; i++) {
+                queues.emplace_back(new Queue);
+            }
+            for (int i = 1; i < threads; i++) {
+                workers.emplace_back([this, i] { worker_loop(i); });
+            }
+        }
+
+        ~WorkStealingPool() {
+            {
+                std::lock_guard<std::mutex> lock(wake_mutex);
+                stop = true;
+            }
+            wake.notify_all();
+            for (std::thread& worker : workers) {
+                worker.join();
+            }
+        }
+
+        int size() const { return (int)queues.size(); }
+
+        // Adds task to worker's own deque, may be called from running tasks
+        void spawn(int worker, Task task) {
+            pending.fetch_add(1);
+            {
+                std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+                queues[worker]->tasks.push_back(std::move(task));
+            }
+        }
+
+        // Spreads copies of tasks over all deques and returns when they and everything they
+        // spawned are done, so the caller can keep one task list for many runs
+        void run(const std::vector<Task>& tasks) {
+            for (size_t i = 0; i < tasks.size(); i++) {
+                spawn((int)(i % queues.size()), tasks[i]);
+            }
+            {
+                std::lock_guard<std::mutex> lock(wake_mutex);
+            }
+            wake.notify_all();
+            while (pending.load() > 0) {
+                if (!try_run(0)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        struct alignas(64) Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<int> pending{0};
+        std::mutex wake_mutex;
+        std::condition_variable wake;
+        bool stop = false;
+
+        bool try_run(int worker) {
+            Task task;
+            for (int i = 0; i < size() && !task; i++) {
+                Queue& queue = *queues[(worker + i) % size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.tasks.empty()) {
+                    if (i == 0) {
+                        task = std::move(queue.tasks.back());
+                        queue.tasks.pop_back();
+                    } else {
+                        task = std::move(queue.tasks.front());
+                        queue.tasks.pop_front();
+                    }
+                }
+            }
+            if (!task) {
+                return false;
+            }
+            task(worker);
+            pending.fetch_sub(1);
+            return true;
+        }
+
+        void worker_loop(int worker) {
+            while (true) {
+                if (try_run(worker)) {
+                    continue;
+                }
+                if (pending.load() > 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(wake_mutex);
+                wake.wait(lock, [this] { return stop || pending.load() > 0; });
+                if (stop) {
+                    return;
+                }
+            }
+        }
+};
+
+// Tree node, score is in half points (win 2, draw 1) for the player who made move
+struct MctsNode {
+    std::atomic<int32_t> visits;
+    std::atomic<int32_t> score;
+    std::atomic<uint8_t> state;
+    int16_t move;
+    int16_t child_count;
+    MctsNode* children;
+
+    enum State : uint8_t { Leaf, Expanding, Expanded };
+};
+
+// Bump allocator owned by one worker, nodes are never freed one by one
+class NodeArena {
+    public:
+        MctsNode* allocate(int count) {
+            if (chunks.empty() || used + count > chunk_nodes) {
+                if (next_chunk == chunks.size()) {
+                    chunks.emplace_back(new MctsNode[chunk_nodes]);
+                }
+                next_chunk++;
+                used = 0;
+            }
+            MctsNode* nodes = chunks[next_chunk - 1].get() + used;
+            used += count;
+            return nodes;
+        }
+
+        // Keeps chunks for the next search
+        void reset() {
+            next_chunk = 0;
+            used = chunk_nodes;
+        }
+
+    private:
+        static constexpr int chunk_nodes = 1 << 16;
+        std::vector<std::unique_ptr<MctsNode[]>> chunks;
+        size_t next_chunk = 0;
+        int used = chunk_nodes;
+};
+
+// Tree-parallel Monte Carlo Tree Search: all workers grow one tree, statistics are
+// atomic and a virtual loss is added on the way down so threads spread over the tree
+template <int Rows, int Cols, int WinLength>
+class Mcts : public Engine<Rows, Cols, WinLength> {
+    public:
+        typedef Board<Rows, Cols, WinLength> BoardType;
+        static constexpr int squares = BoardType::squares;
+        static constexpr int batch = 64;
+        static constexpr int virtual_loss = 3;
+
+        Mcts(WorkStealingPool& pool, std::chrono::milliseconds budget, long long max_playouts = -1)
+            : pool(pool), budget(budget), max_playouts(max_playouts), arenas(pool.size()) {
+            // built once, every search runs the same batches
+            for (int i = 0; i < pool.size() * 4; i++) {
+                tasks.push_back([this](int worker) { run_batch(worker); });
+            }
+        }
+
+        int best_move(const BoardType& position, char player) override {
+            if (position.legal_moves().none()) {
+                return -1;
+            }
+            for (WorkerArena& arena : arenas) {
+                arena.nodes.reset();
+            }
+            root_board = position;
+            root_player = player;
+            root = arenas[0].nodes.allocate(1);
+            init_node(root, -1);
+            playouts.store(0);
+            auto start = std::chrono::steady_clock::now();
+            deadline = start + budget;
+
+            pool.run(tasks);
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            int best = -1;
+            int best_visits = -1;
+            if (root->state.load(std::memory_order_acquire) == MctsNode::Expanded) {
+                for (int i = 0; i < root->child_count; i++) {
+                    int visits = root->children[i].visits.load(std::memory_order_relaxed);
+                    if (visits > best_visits) {
+                        best_visits = visits;
+                        best = root->children[i].move;
+                    }
+                }
+            }
+            if (best < 0) {
+                root_board.for_each_move([&](int square) { best = best < 0 ? square : best; });
+            }
+            return best;
+        }
+
+        void report(std::ostream& out) const override {
+            out << get_playouts() << " playouts, " << get_playouts_per_second() / 1e3 << " k playouts/s, "
+                << pool.size() << " threads";
+        }
+
+        long long get_playouts() const { return playouts.load(); }
+        double get_playouts_per_second() const { return seconds > 0 ? playouts.load() / seconds : 0; }
+
+    private:
+        struct alignas(64) WorkerArena {
+            NodeArena nodes;
+            uint64_t random = 0;
+        };
+
+        WorkStealingPool& pool;
+        std::chrono::milliseconds budget;
+        long long max_playouts;
+        std::chrono::steady_clock::time_point deadline;
+        std::vector<WorkerArena> arenas;
+        std::vector<WorkStealingPool::Task> tasks;
+        BoardType root_board;
+        char root_player = 'X';
+        MctsNode* root = nullptr;
+        std::atomic<long long> playouts{0};
+        double seconds = 0;
+
+        static char other(char player) { return player == 'X' ? 'O' : 'X'; }
+
+        static void init_node(MctsNode* node, int move) {
+            node->visits.store(0, std::memory_order_relaxed);
+            node->score.store(0, std::memory_order_relaxed);
+            node->state.store(MctsNode::Leaf, std::memory_order_relaxed);
+            node->move = (int16_t)move;
+            node->child_count = 0;
+            node->children = nullptr;
+        }
+
+        static uint32_t next_random(uint64_t& state) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return (uint32_t)(state >> 32);
+        }
+
+        bool finished() const {
+            if (max_playouts >= 0) {
+                return playouts.load(std::memory_order_relaxed) >= max_playouts;
+            }
+            return std::chrono::steady_clock::now() > deadline;
+        }
+
+        // Runs a batch of playouts and queues itself again while there is time left
+        void run_batch(int worker) {
+            WorkerArena& arena = arenas[worker];
+            if (arena.random == 0) {
+                arena.random = 0x2545F4914F6CDD1DULL * (worker + 1);
+            }
+            if (finished()) {
+                return;
+            }
+            for (int i = 0; i < batch; i++) {
+                iterate(arena);
+            }
+            playouts.fetch_add(batch, std::memory_order_relaxed);
+            pool.spawn(worker, [this](int next_worker) { run_batch(next_worker); });
+        }
+
+        MctsNode* select_child(MctsNode* node) const {
+            int parent_visits = node->visits.load(std::memory_order_relaxed);
+            double log_parent = std::log((double)std::max(parent_visits, 1));
+            MctsNode* best = nullptr;
+            double best_value = -1;
+            for (int i = 0; i < node->child_count; i++) {
+                MctsNode* child = &node->children[i];
+                int visits = child->visits.load(std::memory_order_relaxed);
+                if (visits == 0) {
+                    return child;
+                }
+                double mean = child->score.load(std::memory_order_relaxed) / (2.0 * visits);
+                double value = mean + 1.4 * std::sqrt(log_parent / visits);
+                if (value > best_value) {
+                    best_value = value;
+                    best = child;
+                }
+            }
+            return best;
+        }
+
+        // Children are the candidate moves; a winning move or the blocks of
+        // opponent's winning squares are the only children when they exist
+        void expand(MctsNode* node, const BoardType& board, char player, NodeArena& nodes) {
+            typename BoardType::Mask candidates = board.candidate_moves();
+            typename BoardType::Mask wins, blocks;
+            board.for_each_move([&](int square) {
+                if (candidates[square]) {
+                    wins[square] = BoardType::wins_with(board.mask(player), square);
+                    blocks[square] = BoardType::wins_with(board.mask(other(player)), square);
+                }
+            });
+            if (wins.any()) {
+                candidates = wins;
+            } else if (blocks.any()) {
+                candidates = blocks;
+            }
+            int count = (int)candidates.count();
+            MctsNode* children = nodes.allocate(count);
+            int i = 0;
+            board.for_each_move([&](int square) {
+                if (candidates[square]) {
+                    init_node(&children[i++], square);
+                }
+            });
+            node->children = children;
+            node->child_count = (int16_t)count;
+            node->state.store(MctsNode::Expanded, std::memory_order_release);
+        }
+
+        // Random game from board, returns the winner or 0 for draw
+        char playout(BoardType& board, char player, uint64_t& random) const {
+            int moves[squares];
+            int count = 0;
+            board.for_each_move([&](int square) { moves[count++] = square; });
+            while (count > 0) {
+                int pick = next_random(random) % count;
+                int square = moves[pick];
+                moves[pick] = moves[--count];
+                board.set(square, player);
+                if (BoardType::wins_with(board.mask(player), square)) {
+                    return player;
+                }
+                player = other(player);
+            }
+            return 0;
+        }
+
+        void iterate(WorkerArena& arena) {
+            MctsNode* path[squares + 1];
+            int length = 0;
+            BoardType board = root_board;
+            char player = root_player;
+            char winner = 0;
+            bool terminal = false;
+
+            MctsNode* node = root;
+            node->visits.fetch_add(virtual_loss, std::memory_order_relaxed);
+            path[length++] = node;
+            while (node->state.load(std::memory_order_acquire) == MctsNode::Expanded && node->child_count > 0) {
+                node = select_child(node);
+                node->visits.fetch_add(virtual_loss, std::memory_order_relaxed);
+                path[length++] = node;
+                board.set(node->move, player);
+                if (BoardType::wins_with(board.mask(player), node->move)) {
+                    winner = player;
+                    terminal = true;
+                    break;
+                }
+                player = other(player);
+            }
+
+            if (!terminal) {
+                uint8_t leaf = MctsNode::Leaf;
+                if (node->visits.load(std::memory_order_relaxed) > virtual_loss && board.legal_moves().any() &&
+                    node->state.compare_exchange_strong(leaf, MctsNode::Expanding, std::memory_order_acquire)) {
+                    expand(node, board, player, arena.nodes);
+                }
+                winner = playout(board, player, arena.random);
+            }
+
+            // Player who made the move into path[i]: root's mover is the opponent of root_player
+            char mover = other(root_player);
+            for (int i = 0; i < length; i++) {
+                int reward = winner == 0 ? 1 : (winner == mover ? 2 : 0);
+                path[i]->visits.fetch_add(1 - virtual_loss, std::memory_order_relaxed);
+                path[i]->score.fetch_add(reward, std::memory_order_relaxed);
+                mover = other(mover);
+            }
+        }
+};
+
+// Perfect play for 3x3: position code is sum of digit * 3^square (0 empty, 1 X, 2 O).
+// Every legal position is solved at compile time, so a move is one table load.
+// MSVC needs a higher /constexpr:steps limit for the table.
+struct PerfectPlay {
+    int8_t value;  // for side to move: 1 win, 0 draw, -1 loss, 2 not a legal position
+    int8_t move;   // best square, -1 when game is over
+    int8_t plies;  // moves left with perfect play, wins are fastest and losses slowest
+};
+
+constexpr int perfect_play_positions = 19683;
+
+namespace perfect_play_detail {
+    constexpr int pow3[10] = {1, 3, 9, 27, 81, 243, 729, 2187, 6561, 19683};
+
+    constexpr int digit(int code, int square) { return code / pow3[square] % 3; }
+
+    constexpr bool has_line(int code, int player) {
+        const int lines[8][3] = {{0, 1, 2}, {3, 4, 5}, {6, 7, 8}, {0, 3, 6}, {1, 4, 7}, {2, 5, 8}, {0, 4, 8}, {2, 4, 6}};
+        for (const auto& line : lines) {
+            if (digit(code, line[0]) == player && digit(code, line[1]) == player && digit(code, line[2]) == player) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Square after symmetry s: bit 0 flips rows, bit 1 flips columns, bit 2 transposes
+    constexpr int transform_square(int square, int s) {
+        int r = (s & 1) ? 2 - square / 3 : square / 3;
+        int c = (s & 2) ? 2 - square % 3 : square % 3;
+        return (s & 4) ? c * 3 + r : r * 3 + c;
+    }
+
+    constexpr int transform(int code, int s) {
+        int result = 0;
+        for (int square = 0; square < 9; square++) {
+            result += digit(code, square) * pow3[transform_square(square, s)];
+        }
+        return result;
+    }
+
+    struct Entry {
+        PerfectPlay play;
+        bool solved;
+        bool reachable;
+    };
+
+    // Solves the smallest code among symmetric positions once and maps its move for the others
+    constexpr void solve(std::array<Entry, perfect_play_positions>& table, int code) {
+        if (table[code].solved) {
+            return;
+        }
+        int canonical = code;
+        int symmetry = 0;
+        for (int s = 1; s < 8; s++) {
+            int other = transform(code, s);
+            if (other < canonical) {
+                canonical = other;
+                symmetry = s;
+            }
+        }
+        if (canonical != code) {
+            solve(table, canonical);
+            PerfectPlay play = table[canonical].play;
+            if (play.move >= 0) {
+                for (int square = 0; square < 9; square++) {
+                    if (transform_square(square, symmetry) == play.move) {
+                        play.move = (int8_t)square;
+                        break;
+                    }
+                }
+            }
+            table[code].play = play;
+            table[code].solved = true;
+            return;
+        }
+
+        int x_count = 0;
+        int o_count = 0;
+        for (int square = 0; square < 9; square++) {
+            x_count += digit(code, square) == 1;
+            o_count += digit(code, square) == 2;
+        }
+        int player = x_count == o_count ? 1 : 2;
+        PerfectPlay best = {-2, -1, 0};
+        if (has_line(code, 3 - player)) {
+            best = {-1, -1, 0};
+        } else if (x_count + o_count == 9) {
+            best = {0, -1, 0};
+        } else {
+            for (int square = 0; square < 9; square++) {
+                if (digit(code, square) != 0) {
+                    continue;
+                }
+                int child = code + player * pow3[square];
+                solve(table, child);
+                const PerfectPlay& reply = table[child].play;
+                int value = -reply.value;
+                int plies = reply.plies + 1;
+                bool better = value > best.value || (value == best.value && (value > 0 ? plies < best.plies
+                                                                                       : plies > best.plies));
+                if (better) {
+                    best = {(int8_t)value, (int8_t)square, (int8_t)plies};
+                }
+            }
+        }
+        table[code].play = best;
+        table[code].solved = true;
+    }
+
+    // Visits every position of a real game, each is solved through its canonical one
+    constexpr void solve_reachable(std::array<Entry, perfect_play_positions>& table, int code, int player) {
+        if (table[code].reachable) {
+            return;
+        }
+        table[code].reachable = true;
+        solve(table, code);
+        if (table[code].play.move < 0) {
+            return;
+        }
+        for (int square = 0; square < 9; square++) {
+            if (digit(code, square) == 0) {
+                solve_reachable(table, code + player * pow3[square], 3 - player);
+            }
+        }
+    }
+
+    constexpr std::array<PerfectPlay, perfect_play_positions> make_table() {
+        std::array<Entry, perfect_play_positions> entries{};
+        solve_reachable(entries, 0, 1);
+        std::array<PerfectPlay, perfect_play_positions> table{};
+        for (int code = 0; code < perfect_play_positions; code++) {
+            table[code] = entries[code].reachable ? entries[code].play : PerfectPlay{2, -1, 0};
+        }
+        return table;
+    }
+
+    // Code of a 9-bit mask with digit 1, so X mask + 2 * O mask codes is the position
+    constexpr std::array<uint16_t, 512> make_mask_codes() {
+        std::array<uint16_t, 512> codes{};
+        for (int mask = 0; mask < 512; mask++) {
+            for (int square = 0; square < 9; square++) {
+                codes[mask] += (mask >> square & 1) * pow3[square];
+            }
+        }
+        return codes;
+    }
+}
+
+constexpr std::array<PerfectPlay, perfect_play_positions> perfect_play_table = perfect_play_detail::make_table();
+constexpr std::array<uint16_t, 512> perfect_play_mask_codes = perfect_play_detail::make_mask_codes();
+
+constexpr int count_legal_positions() {
+    int count = 0;
+    for (const PerfectPlay& play : perfect_play_table) {
+        count += play.value != 2;
+    }
+    return count;
+}
+
+static_assert(count_legal_positions() == 5478, "3x3 game has 5478 legal positions");
+static_assert(perfect_play_table[0].value == 0 && perfect_play_table[0].plies == 9, "perfect play is a draw");
+
+// Query API: masks have bit (row * 3 + col) set for squares of X and of O.
+// Masks with bits above the board or overlapping squares are not positions,
+// they get value 2 instead of reading past the table
+constexpr PerfectPlay perfect_play(uint16_t x_mask, uint16_t o_mask) {
+    if ((x_mask | o_mask) >= 512 || (x_mask & o_mask)) {
+        return PerfectPlay{2, -1, 0};
+    }
+    return perfect_play_table[perfect_play_mask_codes[x_mask] + 2 * perfect_play_mask_codes[o_mask]];
+}
+
+inline PerfectPlay perfect_play(const ClassicBoard& board) {
+    assert((board.x & board.o).none());
+    return perfect_play((uint16_t)board.x.to_ulong(), (uint16_t)board.o.to_ulong());
+}
+
+// X in the center, O answers on an edge and loses
+static_assert(perfect_play(0x010, 0x002).value == 1, "edge reply loses");
+static_assert(perfect_play(0x200, 0).value == 2 && perfect_play(0x001, 0x001).value == 2, "bad masks are rejected");
+
+class PerfectPlayEngine : public Engine<3, 3, 3> {
+    public:
+        int best_move(const ClassicBoard& position, char) override {
+            last = perfect_play(position);
+            return last.move;
+        }
+
+        void report(std::ostream& out) const override {
+            out << "table, value " << (int)last.value << ", " << (int)last.plies << " plies left";
+        }
+
+    private:
+        PerfectPlay last = {0, -1, 0};
+};
+
+// Alpha-beta search, or the perfect play table on the 3x3 board
+template <int Rows, int Cols, int WinLength>
+std::unique_ptr<Engine<Rows, Cols, WinLength>> make_search_engine(TranspositionTable* table,
+                                                                   std::chrono::milliseconds budget) {
+    if constexpr (Rows == 3 && Cols == 3 && WinLength == 3) {
+        return std::unique_ptr<Engine<3, 3, 3>>(new PerfectPlayEngine());
+    } else if (table) {
+        return std::unique_ptr<Engine<Rows, Cols, WinLength>>(new AlphaBeta<Rows, Cols, WinLength>(*table, budget));
+    } else {
+        return std::unique_ptr<Engine<Rows, Cols, WinLength>>(
+            new AlphaBeta<Rows, Cols, WinLength>(Rows * Cols <= 64 ? 1 : 16, budget));
+    }
+}
+
+// Totals of many games, histograms are indexed by square and by game length
+template <int Rows, int Cols, int WinLength>
+struct SelfPlayStats {
+    static constexpr int squares = Rows * Cols;
+
+    long long games = 0;
+    long long x_wins = 0;
+    long long o_wins = 0;
+    long long draws = 0;
+    long long x_moves[squares] = {};
+    long long o_moves[squares] = {};
+    long long lengths[squares + 1] = {};
+
+    void add(const SelfPlayStats& other) {
+        games += other.games;
+        x_wins += other.x_wins;
+        o_wins += other.o_wins;
+        draws += other.draws;
+        for (int i = 0; i < squares; i++) {
+            x_moves[i] += other.x_moves[i];
+            o_moves[i] += other.o_moves[i];
+        }
+        for (int i = 0; i <= squares; i++) {
+            lengths[i] += other.lengths[i];
+        }
+    }
+
+    // Long format: metric,index,value
+    void write_csv(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        out << "metric,index,value\n";
+        out << "games,," << games << "\n";
+        out << "x_wins,," << x_wins << "\n";
+        out << "o_wins,," << o_wins << "\n";
+        out << "draws,," << draws << "\n";
+        for (int i = 0; i < squares; i++) {
+            out << "x_move," << i << "," << x_moves[i] << "\n";
+        }
+        for (int i = 0; i < squares; i++) {
+            out << "o_move," << i << "," << o_moves[i] << "\n";
+        }
+        for (int i = 0; i <= squares; i++) {
+            out << "length," << i << "," << lengths[i] << "\n";
+        }
+    }
+};
+
+// Plays games between two engines on all cores without the interactive loop.
+// Every thread makes its own engines and stats once, games reuse their memory.
+template <int Rows, int Cols, int WinLength>
+class SelfPlay {
+    public:
+        typedef Board<Rows, Cols, WinLength> BoardType;
+        typedef SelfPlayStats<Rows, Cols, WinLength> Stats;
+        typedef std::function<std::unique_ptr<Engine<Rows, Cols, WinLength>>(int worker)> EngineFactory;
+
+        SelfPlay(EngineFactory make_x, EngineFactory make_o,
+                 int threads = (int)std::max(1u, std::thread::hardware_concurrency()))
+            : make_x(make_x), make_o(make_o), threads(threads) {}
+
+        // Returns the winner or 0 for draw, moves are counted into stats
+        static char play_game(Engine<Rows, Cols, WinLength>& x, Engine<Rows, Cols, WinLength>& o, Stats& stats) {
+            BoardType board;
+            char player = 'X';
+            char winner = 0;
+            int length = 0;
+            while (length < BoardType::squares) {
+                int square = (player == 'X' ? x : o).best_move(board, player);
+                board.set(square, player);
+                (player == 'X' ? stats.x_moves : stats.o_moves)[square]++;
+                length++;
+                if (BoardType::wins_with(board.mask(player), square)) {
+                    winner = player;
+                    break;
+                }
+                player = player == 'X' ? 'O' : 'X';
+            }
+            stats.games++;
+            stats.lengths[length]++;
+            if (winner == 'X') {
+                stats.x_wins++;
+            } else if (winner == 'O') {
+                stats.o_wins++;
+            } else {
+                stats.draws++;
+            }
+            return winner;
+        }
+
+        Stats run(long long games) {
+            struct alignas(64) Worker {
+                Stats stats;
+            };
+            std::vector<Worker> results(threads);
+            std::atomic<long long> next{0};
+            const long long chunk = 256;
+            auto body = [&](int worker) {
+                std::unique_ptr<Engine<Rows, Cols, WinLength>> x = make_x(worker);
+                std::unique_ptr<Engine<Rows, Cols, WinLength>> o = make_o(worker);
+                Stats& stats = results[worker].stats;
+                while (true) {
+                    long long first = next.fetch_add(chunk);
+                    if (first >= games) {
+                        break;
+                    }
+                    for (long long game = first; game < std::min(first + chunk, games); game++) {
+                        play_game(*x, *o, stats);
+                    }
+                }
+            };
+            std::vector<std::thread> pool;
+            for (int worker = 1; worker < threads; worker++) {
+                pool.emplace_back(body, worker);
+            }
+            body(0);
+            for (std::thread& thread : pool) {
+                thread.join();
+            }
+            Stats total;
+            for (const Worker& result : results) {
+                total.add(result.stats);
+            }
+            return total;
+        }
+
+    private:
+        EngineFactory make_x;
+        EngineFactory make_o;
+        int threads;
+};
+
+template <int Rows = 3, int Cols = 3, int WinLength = 3>
 class TicTacToe {
     private:
-        char board[3][3];
+        Board<Rows, Cols, WinLength> board;
+        int last_move = -1;
         char current_player = 'X';
         bool game_over = false;
         const char default_char = '-';
+        std::unique_ptr<TranspositionTable> table;
+        std::unique_ptr<WorkStealingPool> pool;
+        std::unique_ptr<Engine<Rows, Cols, WinLength>> computer[2];
     public:
-        TicTacToe() {
-            for (int i = 0; i < 3; i++) {
-                for (int j = 0; j < 3; j++) {
-                    board[i][j] = default_char;
+        TicTacToe() {}
+
+        // Lets the computer play for player, with budget of time per move.
+        // Alpha-beta search by default, Monte Carlo tree search when monte_carlo is set
+        void set_computer(char player, std::chrono::milliseconds budget, bool monte_carlo = false) {
+            std::unique_ptr<Engine<Rows, Cols, WinLength>>& engine = computer[player == 'X' ? 0 : 1];
+            if (monte_carlo) {
+                if (!pool) {
+                    pool.reset(new WorkStealingPool());
+                }
+                engine.reset(new Mcts<Rows, Cols, WinLength>(*pool, budget));
+            } else {
+                if (!table) {
+                    table.reset(new TranspositionTable(Rows * Cols <= 64 ? 1 : 64));
                 }
+                engine = make_search_engine<Rows, Cols, WinLength>(table.get(), budget);
             }
         }
 
         void print_board() {
-            std::cout << "  0 1 2\n";
-            for (int i = 0; i < 3; i++) {
-                std::cout << i << " ";
-                for (int j = 0; j < 3; j++) {
-                    std::cout << board[i][j] << " ";
+            std::cout << "   ";
+            for (int j = 0; j < Cols; j++) {
+                std::cout << j << (j < 10 ? "  " : " ");
+            }
+            std::cout << "\n";
+            for (int i = 0; i < Rows; i++) {
+                std::cout << i << (i < 10 ? "  " : " ");
+                for (int j = 0; j < Cols; j++) {
+                    std::cout << board.at(i * Cols + j, default_char) << "  ";
                 }
                 std::cout << "\n";
             }
@@ -29,30 +1384,40 @@ class TicTacToe {
         void next_player() { current_player = (current_player == 'X') ? 'O' : 'X'; }
 
         bool validate_turn(int row, int col) {
-            return (row >= 0 && row < 3 && col >= 0 && col < 3 && board[row][col] == default_char);
+            return (row >= 0 && row < Rows && col >= 0 && col < Cols && board.is_free(row * Cols + col));
         }
 
         void set_value(int row, int col) {
-            board[row][col] = current_player;
+            last_move = row * Cols + col;
+            board.set(last_move, current_player);
         }
 
         void make_turn() {
-            char row, col;
+            if (auto& search = computer[current_player == 'X' ? 0 : 1]) {
+                int square = search->best_move(board, current_player);
+                std::cout << "Player " << current_player << " plays " << square / Cols << " " << square % Cols << " (";
+                search->report(std::cout);
+                std::cout << ")\n";
+                set_value(square / Cols, square % Cols);
+                return;
+            }
             int row_int, col_int;
             while (true) {
                 std::cout << "Player " << current_player << " turn:\n";
                 std::cout << "Row: ";
-                std::cin >> row;
+                std::cin >> row_int;
                 std::cout << "Col: ";
-                std::cin >> col;
-                if (!std::isdigit(row) && !std::isdigit(col)) {
+                std::cin >> col_int;
+                if (!std::cin) {
+                    if (std::cin.eof()) {
+                        std::exit(0);
+                    }
+                    std::cin.clear();
+                    std::cin.ignore(1024, '\n');
                     std::cout << "Inputs not are numbers\n";
                     continue;
                 }
 
-                row_int = row - '0';
-                col_int = col - '0';
-
                 if (!validate_turn(row_int, col_int)) {
                     std::cout << "Invalid turn, number out of range or position already taken\n";
                     continue;
@@ -62,23 +1427,11 @@ class TicTacToe {
             }
         }
 
+        // Only the player who made the last move can have a new line
         char check_winner() {
-            for (int i = 0; i < 3; i++) {
-                if (board[i][0] == board[i][1] && board[i][1] == board[i][2] && board[i][0] != default_char) {
-                    return board[i][0];
-                }
-                if (board[0][i] == board[1][i] && board[1][i] == board[2][i] && board[0][i] != default_char) {
-                    return board[0][i];
-                }
-            }
-
-            if (board[0][0] == board[1][1] && board[1][1] == board[2][2] && board[0][0] != default_char) {
-                return board[0][0];
-            }
-            if (board[0][2] == board[1][1] && board[1][1] == board[2][0] && board[0][2] != default_char) {
-                return board[0][2];
+            if (last_move >= 0 && board.wins_with(board.mask(current_player), last_move)) {
+                return current_player;
             }
-
             return default_char;
         }
 
@@ -90,14 +1443,240 @@ class TicTacToe {
                 if (winner != default_char) {
                     std::cout << "Player " << winner << " wins!" << std::endl;
                     game_over = true;
+                } else if (board.legal_moves().none()) {
+                    std::cout << "Draw!" << std::endl;
+                    game_over = true;
                 }
                 next_player();
             }
         }
 };
 
-int main() {
-    TicTacToe game;
+// Previous check_winner on char board, kept for the benchmark
+char check_winner_scan(const char board[3][3], char default_char) {
+    for (int i = 0; i < 3; i++) {
+        if (board[i][0] == board[i][1] && board[i][1] == board[i][2] && board[i][0] != default_char) {
+            return board[i][0];
+        }
+        if (board[0][i] == board[1][i] && board[1][i] == board[2][i] && board[0][i] != default_char) {
+            return board[0][i];
+        }
+    }
+
+    if (board[0][0] == board[1][1] && board[1][1] == board[2][2] && board[0][0] != default_char) {
+        return board[0][0];
+    }
+    if (board[0][2] == board[1][1] && board[1][1] == board[2][0] && board[0][2] != default_char) {
+        return board[0][2];
+    }
+
+    return default_char;
+}
+
+// Same random positions checked with both representations
+void benchmark_check_winner() {
+    const int positions = 4096;
+    const int rounds = 2000;
+    std::mt19937 random(42);
+    std::vector<ClassicBoard> bitboards(positions);
+    std::vector<char> boards(positions * 9);
+    for (int p = 0; p < positions; p++) {
+        for (int square = 0; square < 9; square++) {
+            int value = random() % 3;
+            char c = value == 0 ? '-' : (value == 1 ? 'X' : 'O');
+            boards[p * 9 + square] = c;
+            if (c != '-') {
+                bitboards[p].set(square, c);
+            }
+        }
+    }
+
+    long long wins = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int p = 0; p < positions; p++) {
+            wins += check_winner_scan((const char(*)[3])&boards[p * 9], '-') != '-';
+        }
+    }
+    std::chrono::duration<double> scan = std::chrono::steady_clock::now() - start;
+
+    long long bit_wins = 0;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int p = 0; p < positions; p++) {
+            bit_wins += ClassicBoard::has_line(bitboards[p].x) || ClassicBoard::has_line(bitboards[p].o);
+        }
+    }
+    std::chrono::duration<double> bits = std::chrono::steady_clock::now() - start;
+
+    double checks = (double)positions * rounds;
+    std::cout << "char board scan: " << checks / scan.count() / 1e6 << " M checks/s (" << wins << " wins)\n";
+    std::cout << "bitboard masks:  " << checks / bits.count() / 1e6 << " M checks/s (" << bit_wins << " wins)\n";
+}
+
+// Arguments: "ai" - computer plays O, "self" - computer plays both sides,
+// "mcts" - computer uses Monte Carlo tree search, "ms=<n>" - time per computer move
+template <int Rows, int Cols, int WinLength>
+void run_game(int argc, char** argv) {
+    TicTacToe<Rows, Cols, WinLength> game;
+    std::chrono::milliseconds budget(1000);
+    bool monte_carlo = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "ms=", 3) == 0) {
+            budget = std::chrono::milliseconds(atoi(argv[i] + 3));
+        }
+        monte_carlo |= strcmp(argv[i], "mcts") == 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "self") == 0) {
+            game.set_computer('X', budget, monte_carlo);
+        }
+        if (strcmp(argv[i], "ai") == 0 || strcmp(argv[i], "self") == 0) {
+            game.set_computer('O', budget, monte_carlo);
+        }
+    }
     game.play();
+}
+
+// Compares the table with alpha-beta search on every legal position
+bool check_perfect_play() {
+    TranspositionTable table(1);
+    AlphaBeta<3, 3, 3> search(table, std::chrono::milliseconds(1000));
+    int checked = 0;
+    int errors = 0;
+    for (int x = 0; x < 512; x++) {
+        for (int o = 0; o < 512; o++) {
+            if (x & o) {
+                continue;
+            }
+            PerfectPlay play = perfect_play((uint16_t)x, (uint16_t)o);
+            if (play.value == 2 || play.move < 0) {
+                continue;
+            }
+            ClassicBoard board;
+            board.x = ClassicBoard::Mask((unsigned long long)x);
+            board.o = ClassicBoard::Mask((unsigned long long)o);
+            char player = board.x.count() == board.o.count() ? 'X' : 'O';
+            search.best_move(board, player);
+            int score = search.get_score();
+            int value = score > 0 ? 1 : (score < 0 ? -1 : 0);
+            board.set(play.move, player);
+            PerfectPlay reply = perfect_play(board);
+            bool won = ClassicBoard::wins_with(board.mask(player), play.move);
+            if (value != play.value || (won ? play.value != 1 : reply.value != -play.value)) {
+                errors++;
+            }
+            checked++;
+        }
+    }
+    std::cout << "perfect play table: " << checked << " positions checked, " << errors << " errors\n";
+    return errors == 0;
+}
+
+// Playouts per second on the empty 15x15 board for growing thread counts
+void benchmark_mcts() {
+    int max_threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    double single = 0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        WorkStealingPool pool(threads);
+        Mcts<15, 15, 5> search(pool, std::chrono::milliseconds(1000));
+        search.best_move(Board<15, 15, 5>(), 'X');
+        double rate = search.get_playouts_per_second();
+        single = threads == 1 ? rate : single;
+        std::cout << "mcts " << threads << " threads: " << rate / 1e3 << " k playouts/s (x" << rate / single
+                  << ")\n";
+        if (threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+}
+
+// Arguments after "sim": "games=<n>", "x=<policy>", "o=<policy>" (random, ai, search or mcts),
+// "ms=<n>" - time per computer move, "out=<path>" - CSV report
+template <int Rows, int Cols, int WinLength>
+void run_simulation(int argc, char** argv) {
+    long long games = 100000;
+    std::string policies[2] = {"random", "random"};
+    std::string out = "selfplay.csv";
+    std::chrono::milliseconds budget(100);
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "games=", 6) == 0) {
+            games = atoll(argv[i] + 6);
+        } else if (strncmp(argv[i], "x=", 2) == 0) {
+            policies[0] = argv[i] + 2;
+        } else if (strncmp(argv[i], "o=", 2) == 0) {
+            policies[1] = argv[i] + 2;
+        } else if (strncmp(argv[i], "out=", 4) == 0) {
+            out = argv[i] + 4;
+        } else if (strncmp(argv[i], "ms=", 3) == 0) {
+            budget = std::chrono::milliseconds(atoi(argv[i] + 3));
+        }
+    }
+
+    typedef typename SelfPlay<Rows, Cols, WinLength>::EngineFactory EngineFactory;
+    std::vector<std::unique_ptr<WorkStealingPool>> pools((size_t)std::max(1u, std::thread::hardware_concurrency()));
+    EngineFactory factories[2];
+    for (int side = 0; side < 2; side++) {
+        const std::string policy = policies[side];
+        if (policy == "ai") {
+            factories[side] = [budget](int) { return make_search_engine<Rows, Cols, WinLength>(nullptr, budget); };
+        } else if (policy == "search") {
+            factories[side] = [budget](int) {
+                return std::unique_ptr<Engine<Rows, Cols, WinLength>>(
+                    new AlphaBeta<Rows, Cols, WinLength>(Rows * Cols <= 64 ? 1 : 16, budget));
+            };
+        } else if (policy == "mcts") {
+            factories[side] = [budget, &pools](int worker) {
+                if (!pools[worker]) {
+                    pools[worker].reset(new WorkStealingPool(1));
+                }
+                return std::unique_ptr<Engine<Rows, Cols, WinLength>>(
+                    new Mcts<Rows, Cols, WinLength>(*pools[worker], budget));
+            };
+        } else if (policy == "random") {
+            factories[side] = [side](int worker) {
+                return std::unique_ptr<Engine<Rows, Cols, WinLength>>(
+                    new RandomEngine<Rows, Cols, WinLength>(0x9E3779B97F4A7C15ULL * (2 * worker + side + 1)));
+            };
+        } else {
+            throw std::runtime_error("Unknown policy " + policy);
+        }
+    }
+
+    SelfPlay<Rows, Cols, WinLength> simulator(factories[0], factories[1], (int)pools.size());
+    auto start = std::chrono::steady_clock::now();
+    SelfPlayStats<Rows, Cols, WinLength> stats = simulator.run(games);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stats.write_csv(out);
+    std::cout << policies[0] << " vs " << policies[1] << ": " << stats.games << " games, X " << stats.x_wins
+              << ", O " << stats.o_wins << ", draws " << stats.draws << " (" << stats.games / elapsed.count()
+              << " games/s), report in " << out << "\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        benchmark_check_winner();
+        benchmark_mcts();
+        return check_perfect_play() ? 0 : 1;
+    }
+    bool gomoku = false;
+    bool simulation = false;
+    for (int i = 1; i < argc; i++) {
+        gomoku |= strcmp(argv[i], "gomoku") == 0;
+        simulation |= strcmp(argv[i], "sim") == 0;
+    }
+    if (simulation) {
+        if (gomoku) {
+            run_simulation<15, 15, 5>(argc, argv);
+        } else {
+            run_simulation<3, 3, 3>(argc, argv);
+        }
+        return 0;
+    }
+    if (gomoku) {
+        run_game<15, 15, 5>(argc, argv);
+        return 0;
+    }
+    run_game<3, 3, 3>(argc, argv);
     return 0;
-}
\ No newline at end of file
+}
@@ -1,112 +1,3235 @@
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <new>
 #include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define WAV_X86 1
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 // RIFF headers, that will be used by third
 // party software to identificate wav file
 // and its parameters
 // More info: https://docs.fileformat.com/audio/wav/
+// Header is written to the file as is with a single write,
+// so it is packed and its layout is checked at compile time.
+// Multi-byte fields are little-endian like the host CPU
+#pragma pack(push, 1)
 struct RIFF_header
 {
-    const char *riff = "RIFF";
-    char *file_size;
-    const char *wave_fmt = "WAVEfmt ";
-    const char *fmt_size = "16";
-    const char *fmt_type = "1";
-    char *channels;
-    char *sample_rate;
-    char *byte_rate;
-    char *block_align;
-    const char *bits_per_sample = "16";
-    const char *data = "data";
-    char *data_size;
+    char riff[4];                               // "RIFF" header
+    uint32_t file_size;                         // size of the file without first 8 bytes
+    char wave_fmt[8];                           // "WAVEfmt " to indentify file as wav
+    uint32_t fmt_size;                          // size of the fmt chunk
+    uint16_t fmt_type;                          // format type (1 - PCM, 3 - IEEE float)
+    uint16_t channels;                          // number of channels
+    uint32_t sample_rate;                       // sample rate
+    uint32_t byte_rate;                         // byte rate
+    uint16_t block_align;                       // size of one frame in bytes
+    uint16_t bits_per_sample;                   // bits per sample
+    char data[4];                               // "data" header, containing all audio data
+    uint32_t data_size;                         // size of audio data
 };
+#pragma pack(pop)
+
+static_assert(sizeof(RIFF_header) == 44, "RIFF header must be 44 bytes");
+static_assert(offsetof(RIFF_header, file_size) == 4, "file_size must follow \"RIFF\"");
+static_assert(offsetof(RIFF_header, data_size) == 40, "data_size must be the last field");
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "RIFF_header is written as is and requires little-endian host"
+#endif
+
+// Largest data chunk a RIFF file can describe: RIFF size
+// (header, data and pad byte) must fit in 32 bits
+constexpr uint64_t max_data_size = UINT32_MAX - (sizeof(RIFF_header) - 8) - 1;
+
+// Build header for given format, 32-bit samples
+// are stored as IEEE float, others as integer PCM.
+// Odd data size is followed by a pad byte counted in RIFF size
+constexpr RIFF_header make_riff_header(uint32_t sample_rate, uint16_t channels,
+                                       uint16_t bits_per_sample, uint32_t data_size = 0)
+{
+    return RIFF_header{
+        {'R', 'I', 'F', 'F'},
+        (uint32_t)(sizeof(RIFF_header) - 8 + data_size + (data_size & 1)),
+        {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '},
+        16,
+        (uint16_t)(bits_per_sample == 32 ? 3 : 1),
+        channels,
+        sample_rate,
+        sample_rate * channels * bits_per_sample / 8,
+        (uint16_t)(channels * bits_per_sample / 8),
+        bits_per_sample,
+        {'d', 'a', 't', 'a'},
+        data_size,
+    };
+}
+
+static_assert(make_riff_header(44100, 2, 16).byte_rate == 176400, "byte rate of CD audio");
+static_assert(make_riff_header(44100, 2, 16).block_align == 4, "frame of 16-bit stereo");
+static_assert(make_riff_header(48000, 1, 32).fmt_type == 3, "32-bit samples are float");
+
+// Fixed-size block of frames used by streaming mode.
+// Frames are pushed into the block, when it fills up it has
+// to be flushed by the owner (converted and written right away,
+// AsyncWriter does the queueing), so one block is enough and
+// memory usage does not depend on clip length
+class BlockBuffer
+{
+public:
+    static const size_t block_frames = 4096;    // Frames in the block
+
+private:
+    int channels;                               // Samples in one frame
+    std::vector<float> frames;                  // Interleaved frames
+    size_t filled = 0;                          // Frames in the block
+
+    float *block() { return frames.data(); }
+
+public:
+    BlockBuffer(int channels) : channels(channels), frames(block_frames * channels) {}
+
+    // Push frame (one sample per channel) into
+    // the block, returns true when block became full
+    bool push_frame(const float *frame)
+    {
+        memcpy(tail(), frame, sizeof(float) * channels);
+        return commit(1);
+    }
+
+    // Interleaved frames of the block
+    const float *data() const { return frames.data(); }
+    size_t size() const { return filled; }
+
+    // Free part of the block, can be filled
+    // directly and then committed
+    float *tail() { return block() + filled * channels; }
+    size_t space() const { return block_frames - filled; }
+
+    // Mark count frames written to tail() as pushed,
+    // returns true when block became full
+    bool commit(size_t count)
+    {
+        filled += count;
+        return filled == block_frames;
+    }
+
+    // Empty the block after it was flushed
+    void clear()
+    {
+        filled = 0;
+    }
+};
+
+// Block oscillator engine. Whole buffers are filled at once by a
+// kernel chosen at runtime: AVX2+FMA (8 lanes), SSE4.1 (4 lanes)
+// or plain scalar code on other CPUs.
+//
+// Phase is kept in turns (0..1). Every lane computes its own phase
+// as start + i * increment in double precision (so there is no drift
+// over long blocks), folds it to x in [-0.5, 0.5] and then
+// to y in [-0.25, 0.25] by symmetry, where sin(2*pi*y) is evaluated
+// with an odd polynomial of degree 11 (Taylor series of sin).
+// Accuracy: max absolute error against std::sin is below 1e-6 of
+// the amplitude on every path (about 1.4e-7 measured, see
+// check_oscillator_accuracy), square/saw/triangle are not band-limited
+enum class Waveform
+{
+    Sine,
+    Square,
+    Saw,
+    Triangle
+};
+
+enum class SimdLevel
+{
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+#if defined(__GNUC__)
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+// Best SIMD level supported by current CPU
+SimdLevel detect_simd_level()
+{
+#if defined(WAV_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return SimdLevel::SSE41;
+#elif defined(WAV_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool sse41 = info[2] & (1 << 19);
+    bool fma = info[2] & (1 << 12);
+    bool os_avx = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    bool avx2 = info[1] & (1 << 5);
+    if (avx2 && fma && os_avx)
+        return SimdLevel::AVX2;
+    if (sse41)
+        return SimdLevel::SSE41;
+#endif
+    return SimdLevel::Scalar;
+}
+
+const char *simd_level_name(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::AVX2:
+        return "avx2";
+    case SimdLevel::SSE41:
+        return "sse4.1";
+    default:
+        return "scalar";
+    }
+}
+
+// Coefficients of sin(2*pi*y) = y * (c1 + c3*y^2 + c5*y^4 + ...)
+const float sin_c1 = 6.28318531f;
+const float sin_c3 = -41.3417022f;
+const float sin_c5 = 81.6052493f;
+const float sin_c7 = -76.7058598f;
+const float sin_c9 = 42.0586939f;
+const float sin_c11 = -15.0946426f;
+
+// Signature shared by all oscillator kernels
+typedef void (*OscillatorKernel)(float *out, size_t count, double phase, double increment,
+                                 float amplitude, Waveform waveform);
+
+void oscillator_scalar(float *out, size_t count, double phase, double increment,
+                       float amplitude, Waveform waveform)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double p = phase + i * increment;
+        float x = (float)(p - nearbyint(p)); // [-0.5, 0.5]
+        float value;
+        if (waveform == Waveform::Square)
+        {
+            value = x >= 0 ? 1.0f : -1.0f;
+        }
+        else if (waveform == Waveform::Saw)
+        {
+            value = 2 * x;
+        }
+        else
+        {
+            // fold to [-0.25, 0.25], where both sine and triangle are odd
+            float y = fabsf(x) > 0.25f ? copysignf(0.5f, x) - x : x;
+            if (waveform == Waveform::Triangle)
+            {
+                value = 4 * y;
+            }
+            else
+            {
+                float y2 = y * y;
+                value = y * (sin_c1 + y2 * (sin_c3 + y2 * (sin_c5 + y2 * (sin_c7 + y2 * (sin_c9 + y2 * sin_c11)))));
+            }
+        }
+        out[i] = amplitude * value;
+    }
+}
+
+#ifdef WAV_X86
+TARGET_SSE41 void oscillator_sse41(float *out, size_t count, double phase, double increment,
+                                   float amplitude, Waveform waveform)
+{
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 amp = _mm_set1_ps(amplitude);
+    const __m128d lanes_lo = _mm_setr_pd(0, 1);
+    const __m128d lanes_hi = _mm_setr_pd(2, 3);
+    const __m128d inc = _mm_set1_pd(increment);
+    const __m128d start = _mm_set1_pd(phase);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        // phase is computed in double, then only the fraction is narrowed to float
+        __m128d index = _mm_set1_pd((double)i);
+        __m128d p_lo = _mm_add_pd(start, _mm_mul_pd(_mm_add_pd(index, lanes_lo), inc));
+        __m128d p_hi = _mm_add_pd(start, _mm_mul_pd(_mm_add_pd(index, lanes_hi), inc));
+        p_lo = _mm_sub_pd(p_lo, _mm_round_pd(p_lo, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        p_hi = _mm_sub_pd(p_hi, _mm_round_pd(p_hi, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        __m128 x = _mm_movelh_ps(_mm_cvtpd_ps(p_lo), _mm_cvtpd_ps(p_hi));
+        __m128 value;
+        if (waveform == Waveform::Square)
+        {
+            value = _mm_or_ps(one, _mm_and_ps(x, sign_mask));
+        }
+        else if (waveform == Waveform::Saw)
+        {
+            value = _mm_add_ps(x, x);
+        }
+        else
+        {
+            __m128 abs_x = _mm_andnot_ps(sign_mask, x);
+            __m128 folded = _mm_sub_ps(_mm_or_ps(half, _mm_and_ps(x, sign_mask)), x);
+            __m128 y = _mm_blendv_ps(x, folded, _mm_cmpgt_ps(abs_x, quarter));
+            if (waveform == Waveform::Triangle)
+            {
+                value = _mm_mul_ps(y, _mm_set1_ps(4.0f));
+            }
+            else
+            {
+                __m128 y2 = _mm_mul_ps(y, y);
+                __m128 r = _mm_set1_ps(sin_c11);
+                r = _mm_add_ps(_mm_mul_ps(r, y2), _mm_set1_ps(sin_c9));
+                r = _mm_add_ps(_mm_mul_ps(r, y2), _mm_set1_ps(sin_c7));
+                r = _mm_add_ps(_mm_mul_ps(r, y2), _mm_set1_ps(sin_c5));
+                r = _mm_add_ps(_mm_mul_ps(r, y2), _mm_set1_ps(sin_c3));
+                r = _mm_add_ps(_mm_mul_ps(r, y2), _mm_set1_ps(sin_c1));
+                value = _mm_mul_ps(r, y);
+            }
+        }
+        _mm_storeu_ps(out + i, _mm_mul_ps(value, amp));
+    }
+    // tail is shorter than one vector
+    oscillator_scalar(out + i, count - i, phase + i * increment, increment, amplitude, waveform);
+}
+
+TARGET_AVX2 void oscillator_avx2(float *out, size_t count, double phase, double increment,
+                                 float amplitude, Waveform waveform)
+{
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 amp = _mm256_set1_ps(amplitude);
+    const __m256d lanes_lo = _mm256_setr_pd(0, 1, 2, 3);
+    const __m256d lanes_hi = _mm256_setr_pd(4, 5, 6, 7);
+    const __m256d inc = _mm256_set1_pd(increment);
+    const __m256d start = _mm256_set1_pd(phase);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256d index = _mm256_set1_pd((double)i);
+        __m256d p_lo = _mm256_fmadd_pd(_mm256_add_pd(index, lanes_lo), inc, start);
+        __m256d p_hi = _mm256_fmadd_pd(_mm256_add_pd(index, lanes_hi), inc, start);
+        p_lo = _mm256_sub_pd(p_lo, _mm256_round_pd(p_lo, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        p_hi = _mm256_sub_pd(p_hi, _mm256_round_pd(p_hi, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(p_lo)), _mm256_cvtpd_ps(p_hi), 1);
+        __m256 value;
+        if (waveform == Waveform::Square)
+        {
+            value = _mm256_or_ps(one, _mm256_and_ps(x, sign_mask));
+        }
+        else if (waveform == Waveform::Saw)
+        {
+            value = _mm256_add_ps(x, x);
+        }
+        else
+        {
+            __m256 abs_x = _mm256_andnot_ps(sign_mask, x);
+            __m256 folded = _mm256_sub_ps(_mm256_or_ps(half, _mm256_and_ps(x, sign_mask)), x);
+            __m256 y = _mm256_blendv_ps(x, folded, _mm256_cmp_ps(abs_x, quarter, _CMP_GT_OQ));
+            if (waveform == Waveform::Triangle)
+            {
+                value = _mm256_mul_ps(y, _mm256_set1_ps(4.0f));
+            }
+            else
+            {
+                __m256 y2 = _mm256_mul_ps(y, y);
+                __m256 r = _mm256_set1_ps(sin_c11);
+                r = _mm256_fmadd_ps(r, y2, _mm256_set1_ps(sin_c9));
+                r = _mm256_fmadd_ps(r, y2, _mm256_set1_ps(sin_c7));
+                r = _mm256_fmadd_ps(r, y2, _mm256_set1_ps(sin_c5));
+                r = _mm256_fmadd_ps(r, y2, _mm256_set1_ps(sin_c3));
+                r = _mm256_fmadd_ps(r, y2, _mm256_set1_ps(sin_c1));
+                value = _mm256_mul_ps(r, y);
+            }
+        }
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(value, amp));
+    }
+    oscillator_scalar(out + i, count - i, phase + i * increment, increment, amplitude, waveform);
+}
+#endif
+
+// Kernel for given SIMD level, falls back to
+// scalar code when level is not available
+OscillatorKernel oscillator_kernel(SimdLevel level)
+{
+#ifdef WAV_X86
+    if (level == SimdLevel::AVX2)
+        return oscillator_avx2;
+    if (level == SimdLevel::SSE41)
+        return oscillator_sse41;
+#endif
+    return oscillator_scalar;
+}
+
+// Oscillator with its own phase, consecutive fill() calls
+// continue the waveform without discontinuities
+class Oscillator
+{
+private:
+    Waveform waveform;                          // Shape of the wave
+    float amplitude;                            // Peak value
+    double phase = 0;                           // Current phase in turns (0..1)
+    double increment;                           // Phase step per sample in turns
+    OscillatorKernel kernel;                    // Kernel chosen for this CPU
+
+public:
+    Oscillator(Waveform waveform, float frequency, float amplitude, int sample_rate,
+               SimdLevel level = detect_simd_level())
+    {
+        this->waveform = waveform;
+        this->amplitude = amplitude;
+        this->increment = (double)frequency / sample_rate;
+        this->kernel = oscillator_kernel(level);
+    }
+
+    // Fill buffer with next count samples
+    void fill(float *out, size_t count)
+    {
+        kernel(out, count, phase, increment, amplitude, waveform);
+        phase = fmod(phase + count * increment, 1.0);
+    }
+
+    // Fill buffer with samples [first, first + count) of the
+    // wave, result does not depend on previous calls
+    void fill_at(float *out, size_t first, size_t count) const
+    {
+        kernel(out, count, fmod(first * increment, 1.0), increment, amplitude, waveform);
+    }
+};
+
+// Conversion of float samples (-1..1) to 16-bit PCM. Values are
+// scaled, rounded to nearest and saturated, all paths give the
+// same result, SIMD ones just do 16 or 8 samples per step
+typedef void (*Int16Kernel)(const float *in, int16_t *out, size_t count);
+
+void float_to_int16_scalar(const float *in, int16_t *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        float v = in[i] * 32767.0f;
+        v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+        out[i] = (int16_t)lrintf(v);
+    }
+}
+
+#ifdef WAV_X86
+TARGET_SSE41 void float_to_int16_sse41(const float *in, int16_t *out, size_t count)
+{
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 lo = _mm_set1_ps(-32768.0f);
+    const __m128 hi = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), lo), hi);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), lo), hi);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i *)(out + i), packed);
+    }
+    float_to_int16_scalar(in + i, out + i, count - i);
+}
+
+TARGET_AVX2 void float_to_int16_avx2(const float *in, int16_t *out, size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(32767.0f);
+    const __m256 lo = _mm256_set1_ps(-32768.0f);
+    const __m256 hi = _mm256_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale), lo), hi);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale), lo), hi);
+        // packs works inside 128-bit lanes, permute restores sample order
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *)(out + i), packed);
+    }
+    float_to_int16_scalar(in + i, out + i, count - i);
+}
+#endif
+
+Int16Kernel int16_kernel(SimdLevel level)
+{
+#ifdef WAV_X86
+    if (level == SimdLevel::AVX2)
+        return float_to_int16_avx2;
+    if (level == SimdLevel::SSE41)
+        return float_to_int16_sse41;
+#endif
+    return float_to_int16_scalar;
+}
+
+// Allocator returning memory aligned to cache line,
+// so SIMD loads from channel planes never split lines
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator
+{
+    typedef T value_type;
+    template <typename U>
+    struct rebind
+    {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+    T *allocate(size_t count) { return (T *)::operator new(count * sizeof(T), std::align_val_t(Alignment)); }
+    void deallocate(T *pointer, size_t) { ::operator delete(pointer, std::align_val_t(Alignment)); }
+
+    bool operator==(const AlignedAllocator &) const { return true; }
+    bool operator!=(const AlignedAllocator &) const { return false; }
+};
+
+// Memory layout of multi-channel audio:
+// Interleaved - L R L R ... (as in WAV files)
+// Planar      - L L L ... R R R ... (one plane per channel)
+enum class FrameLayout
+{
+    Interleaved,
+    Planar
+};
+
+// Non-owning strided view of one channel. Stride is 1 for
+// planar storage and number of channels for interleaved, so
+// channel-wise code works on both layouts without copying
+struct ChannelView
+{
+    float *data;                                // First sample of the channel
+    size_t frames;                              // Number of samples in the channel
+    size_t stride;                              // Distance between samples
+
+    float &operator[](size_t index) const { return data[index * stride]; }
+    size_t size() const { return frames; }
+};
+
+// Kernel writing frames [first, first + count) of planar
+// storage as interleaved samples to out
+typedef void (*InterleaveKernel)(const float *planes, size_t plane_stride, int channels,
+                                 float *out, size_t first, size_t count);
+
+void interleave_scalar(const float *planes, size_t plane_stride, int channels,
+                       float *out, size_t first, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int channel = 0; channel < channels; channel++)
+        {
+            out[i * channels + channel] = planes[channel * plane_stride + first + i];
+        }
+    }
+}
+
+#ifdef WAV_X86
+TARGET_SSE41 void interleave_sse41(const float *planes, size_t plane_stride, int channels,
+                                   float *out, size_t first, size_t count)
+{
+    size_t i = 0;
+    if (channels == 2)
+    {
+        const float *left = planes + first;
+        const float *right = planes + plane_stride + first;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 l = _mm_loadu_ps(left + i);
+            __m128 r = _mm_loadu_ps(right + i);
+            _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+        }
+    }
+    else if (channels == 4)
+    {
+        const float *p = planes + first;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 c0 = _mm_loadu_ps(p + i);
+            __m128 c1 = _mm_loadu_ps(p + plane_stride + i);
+            __m128 c2 = _mm_loadu_ps(p + 2 * plane_stride + i);
+            __m128 c3 = _mm_loadu_ps(p + 3 * plane_stride + i);
+            _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+            _mm_storeu_ps(out + 4 * i, c0);
+            _mm_storeu_ps(out + 4 * i + 4, c1);
+            _mm_storeu_ps(out + 4 * i + 8, c2);
+            _mm_storeu_ps(out + 4 * i + 12, c3);
+        }
+    }
+    interleave_scalar(planes + i, plane_stride, channels, out + i * channels, first, count - i);
+}
+
+TARGET_AVX2 void interleave_avx2(const float *planes, size_t plane_stride, int channels,
+                                 float *out, size_t first, size_t count)
+{
+    if (channels != 2)
+    {
+        interleave_sse41(planes, plane_stride, channels, out, first, count);
+        return;
+    }
+    const float *left = planes + first;
+    const float *right = planes + plane_stride + first;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 l = _mm256_loadu_ps(left + i);
+        __m256 r = _mm256_loadu_ps(right + i);
+        // unpack works inside 128-bit lanes, permute puts halves in order
+        __m256 lo = _mm256_unpacklo_ps(l, r);
+        __m256 hi = _mm256_unpackhi_ps(l, r);
+        _mm256_storeu_ps(out + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    interleave_sse41(planes + i, plane_stride, channels, out + i * channels, first, count - i);
+}
+#endif
+
+InterleaveKernel interleave_kernel(SimdLevel level)
+{
+#ifdef WAV_X86
+    if (level == SimdLevel::AVX2)
+        return interleave_avx2;
+    if (level == SimdLevel::SSE41)
+        return interleave_sse41;
+#endif
+    return interleave_scalar;
+}
+
+// Growable container of N-channel frames in interleaved
+// or planar layout. In planar layout every channel plane
+// starts at 64-byte boundary, so per-channel loops vectorize
+class FrameBuffer
+{
+public:
+    static const size_t plane_alignment = 64 / sizeof(float); // Plane capacity is rounded to this
+
+private:
+    int channels;                               // Samples in one frame
+    FrameLayout layout;                         // Memory layout
+    size_t frames = 0;                          // Frames stored
+    size_t capacity = 0;                        // Frames that fit without reallocation
+    std::vector<float, AlignedAllocator<float>> storage;
+
+    void reserve(size_t needed)
+    {
+        if (needed <= capacity)
+            return;
+        size_t grown = capacity * 2 > needed ? capacity * 2 : needed;
+        grown = (grown + plane_alignment - 1) / plane_alignment * plane_alignment;
+        if (layout == FrameLayout::Interleaved)
+        {
+            storage.resize(grown * channels);
+        }
+        else
+        {
+            // every plane moves to its new place (empty
+            // storage has no data pointer to copy from)
+            std::vector<float, AlignedAllocator<float>> moved(grown * channels);
+            for (int channel = 0; channel < channels && frames > 0; channel++)
+            {
+                memcpy(moved.data() + channel * grown, storage.data() + channel * capacity, sizeof(float) * frames);
+            }
+            storage.swap(moved);
+        }
+        capacity = grown;
+    }
+
+public:
+    FrameBuffer(int channels, FrameLayout layout) : channels(channels), layout(layout) {}
+
+    int get_channels() const { return channels; }
+    FrameLayout get_layout() const { return layout; }
+    size_t size() const { return frames; }
+
+    // Add count frames at the end (values are not
+    // initialized), returns index of the first one
+    size_t append(size_t count)
+    {
+        reserve(frames + count);
+        size_t first = frames;
+        frames += count;
+        return first;
+    }
+
+    void append_frame(const float *frame)
+    {
+        size_t index = append(1);
+        for (int channel = 0; channel < channels; channel++)
+        {
+            at(index, channel) = frame[channel];
+        }
+    }
+
+    float &at(size_t frame, int channel)
+    {
+        return layout == FrameLayout::Planar ? storage[channel * capacity + frame]
+                                             : storage[frame * channels + channel];
+    }
+
+    // Aligned samples of one channel (planar layout only)
+    float *plane(int channel)
+    {
+        return layout == FrameLayout::Planar ? storage.data() + channel * capacity : nullptr;
+    }
+
+    // View of one channel in any layout
+    ChannelView channel(int channel)
+    {
+        if (layout == FrameLayout::Planar)
+            return ChannelView{storage.data() + channel * capacity, frames, 1};
+        return ChannelView{storage.data() + channel, frames, (size_t)channels};
+    }
+
+    // Put the same mono samples to all channels
+    // of frames [first, first + count)
+    void write_mono(size_t first, const float *mono, size_t count)
+    {
+        for (int channel = 0; channel < channels; channel++)
+        {
+            if (layout == FrameLayout::Planar)
+            {
+                memcpy(plane(channel) + first, mono, sizeof(float) * count);
+                continue;
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                storage[(first + i) * channels + channel] = mono[i];
+            }
+        }
+    }
+
+    // Copy count frames from planar source (plane c starts at
+    // planes + c * stride) to frames starting at first
+    void write_planar(size_t first, const float *planes, size_t stride, size_t count)
+    {
+        for (int channel = 0; channel < channels; channel++)
+        {
+            const float *source = planes + channel * stride;
+            if (layout == FrameLayout::Planar)
+            {
+                memcpy(plane(channel) + first, source, sizeof(float) * count);
+                continue;
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                storage[(first + i) * channels + channel] = source[i];
+            }
+        }
+    }
+
+    // Copy frames [first, first + count) to out as interleaved
+    // samples, planar storage is transposed with SIMD
+    void interleave(float *out, size_t first, size_t count) const
+    {
+        if (layout == FrameLayout::Interleaved)
+        {
+            memcpy(out, storage.data() + first * channels, sizeof(float) * count * channels);
+            return;
+        }
+        static const InterleaveKernel kernel = interleave_kernel(detect_simd_level());
+        kernel(storage.data(), capacity, channels, out, first, count);
+    }
+};
+
+// Sample formats of WAV data, 32-bit files written by
+// WavFile are float, S32 is kept for reading and conversion
+enum class SampleFormat
+{
+    U8,
+    S16,
+    S24,
+    S32,
+    F32
+};
+
+// Format of samples with given bit depth (PCM or float)
+SampleFormat sample_format(int bits_per_sample, bool is_float)
+{
+    if (is_float && bits_per_sample == 32)
+        return SampleFormat::F32;
+    switch (bits_per_sample)
+    {
+    case 8:
+        return SampleFormat::U8;
+    case 16:
+        return SampleFormat::S16;
+    case 24:
+        return SampleFormat::S24;
+    case 32:
+        return SampleFormat::S32;
+    }
+    throw std::runtime_error("Unsupported bit depth: " + std::to_string(bits_per_sample));
+}
+
+int sample_bytes(SampleFormat format)
+{
+    switch (format)
+    {
+    case SampleFormat::U8:
+        return 1;
+    case SampleFormat::S16:
+        return 2;
+    case SampleFormat::S24:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+// TPDF dither: sum of two uniform random values gives
+// triangular noise of +-1 LSB, which decorrelates
+// quantization error from the signal
+class Dither
+{
+private:
+    uint32_t state;                             // xorshift32 state
+
+    float uniform()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    }
+
+public:
+    Dither(uint32_t seed = 0x12345678) : state(seed ? seed : 1) {}
+
+    // Noise in LSB units (-1..1)
+    float next() { return uniform() - uniform(); }
+};
+
+// Convert float samples (-1..1) to integer or float format,
+// dither is added before rounding when it is not null
+void convert_samples(const float *in, size_t count, SampleFormat format, Dither *dither, char *out)
+{
+    if (format == SampleFormat::F32)
+    {
+        memcpy(out, in, sizeof(float) * count);
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        float noise = dither ? dither->next() : 0.0f;
+        if (format == SampleFormat::U8)
+        {
+            // 8-bit PCM is unsigned with silence at 128
+            float v = nearbyintf(in[i] * 127.0f + noise) + 128.0f;
+            out[i] = (char)(uint8_t)(v > 255.0f ? 255.0f : (v < 0.0f ? 0.0f : v));
+        }
+        else if (format == SampleFormat::S16)
+        {
+            float v = nearbyintf(in[i] * 32767.0f + noise);
+            int16_t sample = (int16_t)(v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v));
+            memcpy(out + i * 2, &sample, 2);
+        }
+        else if (format == SampleFormat::S24)
+        {
+            float v = nearbyintf(in[i] * 8388607.0f + noise);
+            int32_t sample = (int32_t)(v > 8388607.0f ? 8388607.0f : (v < -8388608.0f ? -8388608.0f : v));
+            out[i * 3] = (char)(sample & 0xFF);
+            out[i * 3 + 1] = (char)((sample >> 8) & 0xFF);
+            out[i * 3 + 2] = (char)((sample >> 16) & 0xFF);
+        }
+        else
+        {
+            // float has only 24 bits of mantissa, so
+            // 32-bit samples are computed in double
+            double v = nearbyint(in[i] * 2147483647.0 + noise);
+            int32_t sample = (int32_t)(v > 2147483647.0 ? 2147483647.0 : (v < -2147483648.0 ? -2147483648.0 : v));
+            memcpy(out + i * 4, &sample, 4);
+        }
+    }
+}
+
+// Convert samples of given format to float (-1..1)
+void samples_to_float(const char *in, size_t count, SampleFormat format, float *out)
+{
+    const uint8_t *bytes = (const uint8_t *)in;
+    for (size_t i = 0; i < count; i++)
+    {
+        switch (format)
+        {
+        case SampleFormat::U8:
+            out[i] = (bytes[i] - 128) / 128.0f;
+            break;
+        case SampleFormat::S16:
+        {
+            int16_t sample;
+            memcpy(&sample, bytes + i * 2, 2);
+            out[i] = sample / 32768.0f;
+            break;
+        }
+        case SampleFormat::S24:
+        {
+            // shift to the top of int32 to sign-extend
+            int32_t sample = (int32_t)((uint32_t)bytes[i * 3] << 8 | (uint32_t)bytes[i * 3 + 1] << 16 |
+                                       (uint32_t)bytes[i * 3 + 2] << 24) >> 8;
+            out[i] = sample / 8388608.0f;
+            break;
+        }
+        case SampleFormat::S32:
+        {
+            int32_t sample;
+            memcpy(&sample, bytes + i * 4, 4);
+            out[i] = (float)(sample / 2147483648.0);
+            break;
+        }
+        case SampleFormat::F32:
+            memcpy(out + i, bytes + i * 4, 4);
+            break;
+        }
+    }
+}
+
+// Polyphase sample rate converter. Ratio out/in is reduced to
+// L/M, windowed-sinc low-pass filter of L * taps coefficients
+// is split into L phases of taps coefficients when created, so
+// every output sample is one dot product over taps input samples.
+// Input is fed in chunks of any size, only last taps - 1 input
+// frames are kept between calls (latency is about taps / 2 frames)
+class Resampler
+{
+public:
+    static const int taps = 32;                 // Coefficients per phase
+
+private:
+    int channels;                               // Samples in one frame
+    size_t up;                                  // L - interpolation factor
+    size_t down;                                // M - decimation factor
+    std::vector<float> table;                   // L phases of taps coefficients, reversed for dot product
+    std::vector<std::vector<float>> history;    // Per channel: kept input + new input
+    size_t position = taps - 1;                 // Newest input sample used by next output
+    size_t phase = 0;                           // Phase of next output (0..L-1)
+
+    static size_t gcd(size_t a, size_t b) { return b == 0 ? a : gcd(b, a % b); }
+
+    // Dot product with 8 independent partial sums, so
+    // compiler can keep them in one vector register
+    static float dot(const float *a, const float *b)
+    {
+        float sums[8] = {0};
+        for (int i = 0; i < taps; i += 8)
+            for (int j = 0; j < 8; j++)
+                sums[j] += a[i + j] * b[i + j];
+        return ((sums[0] + sums[4]) + (sums[1] + sums[5])) + ((sums[2] + sums[6]) + (sums[3] + sums[7]));
+    }
+
+public:
+    Resampler(int input_rate, int output_rate, int channels) : channels(channels), history(channels)
+    {
+        size_t divisor = gcd(input_rate, output_rate);
+        up = output_rate / divisor;
+        down = input_rate / divisor;
+        // cutoff below the lower of two Nyquist frequencies,
+        // in cycles per sample of upsampled (L * input) signal
+        double cutoff = 0.5 / (up > down ? up : down) * 0.95;
+        size_t length = up * taps;
+        double center = (length - 1) / 2.0;
+        table.resize(length);
+        for (size_t p = 0; p < up; p++)
+        {
+            for (int k = 0; k < taps; k++)
+            {
+                size_t j = p + k * up;
+                double t = j - center;
+                double sinc = t == 0 ? 1.0 : sin(2 * M_PI * cutoff * t) / (2 * M_PI * cutoff * t);
+                // Blackman window
+                double window = 0.42 - 0.5 * cos(2 * M_PI * (j + 0.5) / length) + 0.08 * cos(4 * M_PI * (j + 0.5) / length);
+                table[p * taps + (taps - 1 - k)] = (float)(up * 2 * cutoff * sinc * window);
+            }
+        }
+        for (std::vector<float> &samples : history)
+        {
+            samples.assign(taps - 1, 0.0f);
+        }
+    }
+
+    // Delay of the filter in output frames: input frame 0 comes
+    // out as this output frame (half the filter length)
+    size_t latency() const
+    {
+        return (size_t)((up * taps - 1) / 2.0 / down + 0.5);
+    }
+
+    // Output frames that match given number of input frames
+    size_t output_frames(size_t input_frames) const
+    {
+        return (size_t)((uint64_t)input_frames * up / down);
+    }
+
+    // Frames produced at most for given number of input frames
+    size_t max_output(size_t input_frames) const
+    {
+        return ((position - (taps - 1) + input_frames) * up + down - 1) / down + 1;
+    }
+
+    // Feed interleaved input frames, resampled frames are written
+    // as planes to out (plane c at out + c * stride), returns
+    // number of produced frames
+    size_t process(const float *in, size_t frames, float *out, size_t stride)
+    {
+        for (int channel = 0; channel < channels; channel++)
+        {
+            std::vector<float> &samples = history[channel];
+            size_t offset = samples.size();
+            samples.resize(offset + frames);
+            for (size_t i = 0; i < frames; i++)
+                samples[offset + i] = in[i * channels + channel];
+        }
+        size_t available = history[0].size();
+        size_t produced = 0;
+        while (position < available)
+        {
+            const float *coefficients = table.data() + phase * taps;
+            for (int channel = 0; channel < channels; channel++)
+            {
+                out[channel * stride + produced] = dot(coefficients, history[channel].data() + position - (taps - 1));
+            }
+            produced++;
+            phase += down;
+            position += phase / up;
+            phase %= up;
+        }
+        // drop input that no future output needs
+        size_t consumed = position - (taps - 1);
+        consumed = consumed < available ? consumed : available;
+        for (std::vector<float> &samples : history)
+        {
+            samples.erase(samples.begin(), samples.begin() + consumed);
+        }
+        position -= consumed;
+        return produced;
+    }
+
+    // Push silence through the filter to get the delayed
+    // tail of the signal, returns number of produced frames
+    size_t flush(float *out, size_t stride)
+    {
+        std::vector<float> silence((taps / 2 + 1) * channels, 0.0f);
+        return process(silence.data(), taps / 2 + 1, out, stride);
+    }
+};
+
+// Naive linear interpolation resampler (whole clip
+// at once), kept as speed and quality reference
+size_t resample_linear(const float *in, size_t frames, int channels, int input_rate, int output_rate,
+                       std::vector<float> &out)
+{
+    size_t produced = (size_t)((double)frames * output_rate / input_rate);
+    out.resize(produced * channels);
+    double step = (double)input_rate / output_rate;
+    for (size_t i = 0; i < produced; i++)
+    {
+        double position = i * step;
+        size_t index = (size_t)position;
+        float fraction = (float)(position - index);
+        size_t next = index + 1 < frames ? index + 1 : index;
+        for (int channel = 0; channel < channels; channel++)
+        {
+            float a = in[index * channels + channel];
+            float b = in[next * channels + channel];
+            out[i * channels + channel] = a + (b - a) * fraction;
+        }
+    }
+    return produced;
+}
+
+// Bounded lock-free queue for exactly one producer
+// and one consumer thread. Head and tail live on
+// separate cache lines, so threads do not fight for them
+template <typename T>
+class SpscQueue
+{
+private:
+    std::vector<T> slots;                       // capacity + 1 slots, one is always empty
+    alignas(64) std::atomic<size_t> head{0};    // Next slot to pop (owned by consumer)
+    alignas(64) std::atomic<size_t> tail{0};    // Next slot to push (owned by producer)
+
+public:
+    explicit SpscQueue(size_t capacity) : slots(capacity + 1) {}
+
+    // Returns false when queue is full
+    bool push(const T &value)
+    {
+        size_t current = tail.load(std::memory_order_relaxed);
+        size_t next = (current + 1) % slots.size();
+        if (next == head.load(std::memory_order_acquire))
+            return false;
+        slots[current] = value;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false when queue is empty
+    bool pop(T &value)
+    {
+        size_t current = head.load(std::memory_order_relaxed);
+        if (current == tail.load(std::memory_order_acquire))
+            return false;
+        value = std::move(slots[current]);
+        head.store((current + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+};
+
+// How AsyncWriter puts blocks on disk
+enum class WritePolicy
+{
+    Buffered,                                   // Through page cache, kernel writes it back later
+    Direct,                                     // O_DIRECT: bypass page cache (Linux)
+    Sync                                        // Through page cache, fdatasync after every block
+};
+
+// Asynchronous file writer. Caller fills large aligned blocks,
+// full blocks go through a bounded SPSC queue to a background
+// I/O thread, empty ones come back through another queue. Caller
+// only waits for disk when all blocks are in flight.
+// File is treated as byte stream from offset 0, so every block
+// starts at aligned offset (required by O_DIRECT)
+class AsyncWriter
+{
+public:
+    static const size_t block_bytes = 1 << 20;  // Size of one block
+    static const size_t alignment = 4096;       // Alignment of blocks in memory and in file
+
+private:
+    // Command for I/O thread: write size bytes of buffer at offset,
+    // then give buffer back (if owned) and fulfil promise (if any)
+    struct Command
+    {
+        char *buffer = nullptr;
+        uint64_t offset = 0;
+        size_t size = 0;
+        bool owned = false;
+        std::shared_ptr<std::promise<void>> done;
+    };
+
+    WritePolicy policy;
+#ifdef _WIN32
+    FILE *file = nullptr;
+#else
+    int fd = -1;                                // Buffered descriptor (unaligned writes, header)
+    int direct_fd = -1;                         // O_DIRECT descriptor for full blocks
+#endif
+    std::vector<std::vector<char, AlignedAllocator<char, alignment>>> blocks;
+    SpscQueue<Command> full;                    // Caller -> I/O thread
+    SpscQueue<char *> free_blocks;              // I/O thread -> caller
+    char *current = nullptr;                    // Block being filled by caller
+    size_t filled = 0;                          // Bytes in current block
+    uint64_t offset = 0;                        // File offset of current block
+    std::mutex mutex;
+    std::condition_variable wake;               // Wakes I/O thread or waiting caller
+    bool stopping = false;
+    std::string error;                          // First I/O error, reported by flush() and close()
+    std::thread io_thread;
+
+    void write_at(uint64_t position, const char *data, size_t size, bool direct)
+    {
+#ifdef _WIN32
+        (void)direct;
+        _fseeki64(file, (long long)position, SEEK_SET);
+        if (fwrite(data, 1, size, file) != size)
+            error = "Write failed";
+#else
+        int target = direct && direct_fd >= 0 ? direct_fd : fd;
+        while (size > 0)
+        {
+            ssize_t written = pwrite(target, data, size, (off_t)position);
+            if (written <= 0)
+            {
+                error = std::string("Write failed: ") + strerror(errno);
+                return;
+            }
+            data += written;
+            size -= written;
+            position += written;
+        }
+#endif
+    }
+
+    void sync()
+    {
+#ifdef _WIN32
+        fflush(file);
+#elif defined(__APPLE__)
+        fsync(fd);
+#else
+        fdatasync(fd);
+#endif
+    }
+
+    void execute(Command &command)
+    {
+        if (command.size > 0 && error.empty())
+        {
+            // O_DIRECT needs aligned size, unaligned tail goes through page cache
+            size_t aligned = policy == WritePolicy::Direct ? command.size / alignment * alignment : 0;
+            if (aligned > 0)
+                write_at(command.offset, command.buffer, aligned, true);
+            if (aligned < command.size)
+                write_at(command.offset + aligned, command.buffer + aligned, command.size - aligned, false);
+            if (policy == WritePolicy::Sync)
+                sync();
+        }
+        if (command.owned)
+            free_blocks.push(command.buffer);
+        if (command.done)
+        {
+            if (error.empty())
+                command.done->set_value();
+            else
+                command.done->set_exception(std::make_exception_ptr(std::runtime_error(error)));
+        }
+        // caller may wait for a free block
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_all();
+    }
+
+    void io_loop()
+    {
+        Command command;
+        while (true)
+        {
+            if (full.pop(command))
+            {
+                execute(command);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || !full.empty(); });
+            if (stopping && full.empty())
+                return;
+        }
+    }
+
+    void send(const Command &command)
+    {
+        // only empty flush commands can fill the queue up
+        while (!full.push(command))
+            std::this_thread::yield();
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_all();
+    }
+
+    // Hand current block to I/O thread and take next free one,
+    // this is the only place where caller can wait for disk
+    void next_block()
+    {
+        send(Command{current, offset, filled, true, nullptr});
+        offset += filled;
+        filled = 0;
+        current = nullptr;
+        while (!free_blocks.pop(current))
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return !free_blocks.empty(); });
+        }
+    }
+
+public:
+    AsyncWriter(const char *path, size_t queue_blocks = 4, WritePolicy policy = WritePolicy::Buffered)
+        : policy(policy), blocks(queue_blocks + 1), full(queue_blocks + 2), free_blocks(queue_blocks + 1)
+    {
+#ifdef _WIN32
+        file = fopen(path, "wb");
+        if (file == nullptr)
+            throw std::runtime_error(std::string("Can't open file: ") + path);
+#else
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::runtime_error(std::string("Can't open file: ") + path);
+#ifdef O_DIRECT
+        if (policy == WritePolicy::Direct)
+            direct_fd = open(path, O_WRONLY | O_DIRECT);
+#endif
+#endif
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            blocks[i].resize(block_bytes);
+            free_blocks.push(blocks[i].data());
+        }
+        free_blocks.pop(current);
+        io_thread = std::thread(&AsyncWriter::io_loop, this);
+    }
+
+    AsyncWriter(const AsyncWriter &) = delete;
+    AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+    ~AsyncWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    // Append bytes to the stream, copies them to
+    // current block and returns without waiting for disk
+    void write(const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            size_t n = block_bytes - filled < size ? block_bytes - filled : size;
+            memcpy(current + filled, data, n);
+            filled += n;
+            data += n;
+            size -= n;
+            if (filled == block_bytes)
+                next_block();
+        }
+    }
+
+    // Bytes appended so far
+    uint64_t size() const { return offset + filled; }
+
+    // Write everything appended so far. Partial block is copied,
+    // caller keeps filling it and it is written again when full.
+    // Future is ready when data is written (and synced with Sync policy)
+    std::future<void> flush()
+    {
+        auto done = std::make_shared<std::promise<void>>();
+        std::future<void> result = done->get_future();
+        char *copy = nullptr;
+        while (filled > 0 && !free_blocks.pop(copy))
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return !free_blocks.empty(); });
+        }
+        if (copy)
+            memcpy(copy, current, filled);
+        send(Command{copy, offset, filled, copy != nullptr, done});
+        return result;
+    }
+
+    // Overwrite bytes at given offset (for example header with
+    // final sizes), waits for all queued blocks first. Bytes still
+    // in the current block are patched there too, otherwise the
+    // next flush would write the old contents over them
+    void overwrite(uint64_t position, const char *data, size_t size)
+    {
+        flush().get();
+        write_at(position, data, size, false);
+        uint64_t begin = position > offset ? position : offset;
+        uint64_t end = position + size < offset + filled ? position + size : offset + filled;
+        if (begin < end)
+            memcpy(current + (begin - offset), data + (begin - position), end - begin);
+        if (!error.empty())
+            throw std::runtime_error(error);
+    }
+
+    // Write the rest, wait for I/O thread and close file
+    void close()
+    {
+        if (!io_thread.joinable())
+            return;
+        std::future<void> done = flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        io_thread.join();
+        if (policy != WritePolicy::Buffered)
+            sync();
+#ifdef _WIN32
+        fclose(file);
+#else
+        if (direct_fd >= 0)
+            ::close(direct_fd);
+        ::close(fd);
+#endif
+        done.get();
+    }
+};
+
+// Reads frames [first, first + count) as interleaved floats into
+// out and returns number of frames read (less at the end of data)
+typedef std::function<size_t(size_t first, size_t count, float *out)> FrameReader;
+
+// Buffered text output. Numbers are formatted with std::to_chars
+// straight into a large reusable buffer, which goes to the stream
+// only when it is full, so there is no flush or locale per value
+class TextWriter
+{
+private:
+    std::ostream &out;
+    std::vector<char> buffer;
+    size_t used = 0;
+
+    // Make sure at least size bytes are free
+    char *reserve(size_t size)
+    {
+        if (buffer.size() - used < size)
+            flush();
+        return buffer.data() + used;
+    }
+
+public:
+    // Capacity is at least 32 bytes, the longest formatted number
+    explicit TextWriter(std::ostream &out, size_t capacity = 1 << 16)
+        : out(out), buffer(capacity < 32 ? 32 : capacity)
+    {
+    }
+
+    TextWriter(const TextWriter &) = delete;
+    TextWriter &operator=(const TextWriter &) = delete;
+
+    ~TextWriter() { flush(); }
+
+    void put(char c)
+    {
+        *reserve(1) = c;
+        used++;
+    }
+
+    void put(float value)
+    {
+        char *start = reserve(32);
+        used += std::to_chars(start, start + 32, value).ptr - start;
+    }
+
+    void put(uint64_t value)
+    {
+        char *start = reserve(24);
+        used += std::to_chars(start, start + 24, value).ptr - start;
+    }
+
+    // Text that does not fit in the buffer goes straight to the stream
+    void put(const char *text)
+    {
+        size_t length = strlen(text);
+        if (length > buffer.size())
+        {
+            flush();
+            out.write(text, length);
+            return;
+        }
+        memcpy(reserve(length), text, length);
+        used += length;
+    }
+
+    // Pass buffered text to the stream
+    void flush()
+    {
+        out.write(buffer.data(), used);
+        used = 0;
+    }
+};
+
+// Write frames as text lines: values of channels separated by
+// separator, optionally preceded by index of the frame
+void write_frames_text(TextWriter &out, const FrameReader &read, int channels, size_t first, size_t count,
+                       char separator, bool with_index)
+{
+    const size_t chunk = 4096;
+    std::vector<float> frames(chunk * channels);
+    for (size_t done = 0; done < count;)
+    {
+        size_t n = read(first + done, count - done < chunk ? count - done : chunk, frames.data());
+        if (n == 0)
+            break;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (with_index)
+            {
+                out.put((uint64_t)(first + done + i));
+                out.put(separator);
+            }
+            for (int channel = 0; channel < channels; channel++)
+            {
+                out.put(frames[i * channels + channel]);
+                out.put(channel + 1 < channels ? separator : '\n');
+            }
+        }
+        done += n;
+    }
+}
 
 // Class for operations with WAV files
 class WavFile
 {
 private:
-    const char *file_path;                      // Path to file
-    RIFF_header header;                         // RIFF header
-    std::vector<float[2]> audio_data;           // Audio data
-    int sample_rate = 0;                        // Sample rate of audio data in Hz (samples per second)
-    int channels = 0;                           // Number of channels in audio data (1 - mono, 2 - stereo)
-    int bits_per_sample = 0;                    // Number of bits per sample (8 or 16)
+    const char *file_path;                      // Path to file
+    RIFF_header header;                         // RIFF header
+    FrameBuffer audio_data;                     // Audio data (buffered mode only)
+    int sample_rate = 0;                        // Sample rate of audio data in Hz (samples per second)
+    int channels = 0;                           // Number of channels in audio data (1 - mono, 2 - stereo)
+    int bits_per_sample = 0;                    // Number of bits per sample (8, 16, 24 or 32 for float)
+    Int16Kernel to_int16 = int16_kernel(detect_simd_level());
+    Dither dither;                              // Noise generator for integer formats
+    bool use_dither = false;                    // Whether dither is added before rounding
+    std::vector<char> scratch;                  // Converted samples waiting to be written
+    std::vector<float> wave;                    // Mono block produced by oscillator
+
+    std::ofstream stream;                       // Open file in streaming mode
+    std::unique_ptr<AsyncWriter> writer;        // Used instead of stream in async streaming mode
+    bool streaming = false;                     // Whether samples go to stream instead of audio_data
+    BlockBuffer pending;                        // Interleaved frames waiting to be flushed to stream
+    uint64_t streamed_bytes = 0;                // Audio bytes already written to stream
+
+    // Function for writing wav headers to the
+    // start of the current file (ofstream or AsyncWriter)
+    template <typename Output>
+    void write_headers(Output &file)
+    {
+        file.write((const char *)&header, sizeof(header));
+    }
+
+    // Write samples to the file in output format,
+    // returns number of written bytes
+    template <typename Output>
+    size_t write_samples(Output &file, const float *samples, size_t count)
+    {
+        if (bits_per_sample == 32)
+        {
+            file.write((const char *)samples, sizeof(float) * count);
+            return sizeof(float) * count;
+        }
+        // integer formats are converted in chunks, so scratch
+        // buffer stays small even when saving the whole clip
+        const size_t chunk = 1 << 16;
+        SampleFormat format = sample_format(bits_per_sample, false);
+        size_t bytes = bits_per_sample / 8;
+        scratch.resize(chunk * bytes);
+        for (size_t done = 0; done < count; done += chunk)
+        {
+            size_t n = count - done < chunk ? count - done : chunk;
+            if (bits_per_sample == 16 && !use_dither)
+            {
+                to_int16(samples + done, (int16_t *)scratch.data(), n);
+            }
+            else
+            {
+                convert_samples(samples + done, n, format, use_dither ? &dither : nullptr, scratch.data());
+            }
+            file.write(scratch.data(), n * bytes);
+        }
+        return count * bytes;
+    }
+
+    // Write pad byte after odd sized data chunk
+    template <typename Output>
+    void write_pad(Output &file, uint64_t data_size)
+    {
+        if (data_size & 1)
+        {
+            file.write("", 1);
+        }
+    }
+
+    // Flush the pending block to the stream. Block that
+    // would grow data past 4 GiB is dropped and error is thrown,
+    // the file written so far stays valid after close_stream()
+    void flush_block()
+    {
+        uint64_t bytes = (uint64_t)pending.size() * channels * bits_per_sample / 8;
+        if (streamed_bytes + bytes > max_data_size)
+        {
+            pending.clear();
+            throw std::runtime_error("WAV data chunk would exceed 4 GiB");
+        }
+        if (writer)
+            streamed_bytes += write_samples(*writer, pending.data(), pending.size() * channels);
+        else
+            streamed_bytes += write_samples(stream, pending.data(), pending.size() * channels);
+        pending.clear();
+        // AsyncWriter reports its errors itself
+        if (!writer && !stream)
+            throw std::runtime_error(std::string("Write failed: ") + file_path);
+    }
+
+public:
+    // Constructor for creating new wav file, planar layout keeps
+    // each channel contiguous for DSP, interleaved matches the file
+    WavFile(const char *file_path, int sample_rate, int channels, int bits_per_sample,
+            FrameLayout layout = FrameLayout::Planar)
+        : audio_data(channels, layout), pending(channels)
+    {
+        this->file_path = file_path;
+        this->sample_rate = sample_rate;
+        this->channels = channels;
+        this->bits_per_sample = bits_per_sample;
+        this->header = make_riff_header(sample_rate, channels, bits_per_sample);
+    }
+
+    // Start streaming mode: header is written right away
+    // and all following samples go to the file in blocks
+    // instead of being kept in memory until save()
+    void open_stream()
+    {
+        std::cout << "Streaming to file: " << file_path << std::endl;
+        stream.open(file_path, std::ios::binary);
+        if (!stream.is_open())
+            throw std::runtime_error(std::string("Can't open file: ") + file_path);
+        streaming = true;
+        streamed_bytes = 0;
+        // sizes are unknown yet, header is rewritten in close_stream()
+        this->write_headers(stream);
+    }
+
+    // Start streaming mode with background I/O thread: blocks are
+    // converted on the caller thread and written by AsyncWriter,
+    // so generator waits for disk only when its queue is full
+    void open_async_stream(WritePolicy policy = WritePolicy::Buffered, size_t queue_blocks = 4)
+    {
+        std::cout << "Streaming asynchronously to file: " << file_path << std::endl;
+        writer.reset(new AsyncWriter(file_path, queue_blocks, policy));
+        streaming = true;
+        streamed_bytes = 0;
+        this->write_headers(*writer);
+    }
+
+    // Write everything streamed so far, future is ready when
+    // it is on disk (or in page cache for Buffered policy)
+    std::future<void> flush()
+    {
+        if (streaming && writer)
+        {
+            return writer->flush();
+        }
+        stream.flush();
+        std::promise<void> done;
+        done.set_value();
+        return done.get_future();
+    }
+
+    // Finish streaming mode: flush last partial block
+    // and rewrite the header with final sizes
+    void close_stream()
+    {
+        if (!streaming)
+        {
+            return;
+        }
+        flush_block();
+        header = make_riff_header(sample_rate, channels, bits_per_sample, (uint32_t)streamed_bytes);
+        std::cout << "Data size: " << header.data_size << std::endl;
+        streaming = false;
+        if (writer)
+        {
+            write_pad(*writer, streamed_bytes);
+            writer->overwrite(0, (const char *)&header, sizeof(header));
+            writer->close();
+            writer.reset();
+            return;
+        }
+        write_pad(stream, streamed_bytes);
+        stream.seekp(0);
+        this->write_headers(stream);
+        bool written = (bool)stream;
+        stream.close();
+        if (!written || !stream)
+            throw std::runtime_error(std::string("Write failed: ") + file_path);
+    }
+
+    // Explicit close of streaming mode,
+    // I/O errors are thrown from here
+    void close()
+    {
+        close_stream();
+    }
+
+    // Destructor can't throw, errors are only reported,
+    // call close() first to handle them
+    ~WavFile()
+    {
+        try
+        {
+            close_stream();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error closing " << file_path << ": " << e.what() << std::endl;
+        }
+    }
+
+    // Sample new frame of audio data
+    // (one sample per channel)
+    void sample(const float *frame)
+    {
+        if (!streaming)
+        {
+            audio_data.append_frame(frame);
+            return;
+        }
+        if (pending.push_frame(frame))
+        {
+            flush_block();
+        }
+    }
+
+    // Append count frames produced by oscillator (same wave
+    // in every channel), whole blocks are filled at once
+    // without per-sample pushes
+    void generate(Oscillator &oscillator, size_t count)
+    {
+        wave.resize(BlockBuffer::block_frames);
+        while (count > 0)
+        {
+            size_t n = count < wave.size() ? count : wave.size();
+            if (streaming && n > pending.space())
+            {
+                n = pending.space();
+            }
+            oscillator.fill(wave.data(), n);
+            if (!streaming)
+            {
+                audio_data.write_mono(audio_data.append(n), wave.data(), n);
+            }
+            else
+            {
+                float *tail = pending.tail();
+                for (size_t i = 0; i < n; i++)
+                {
+                    for (int channel = 0; channel < channels; channel++)
+                    {
+                        tail[i * channels + channel] = wave[i];
+                    }
+                }
+                if (pending.commit(n))
+                {
+                    flush_block();
+                }
+            }
+            count -= n;
+        }
+    }
+
+    // Append count frames from planar source (plane c
+    // starts at planes + c * stride)
+    void append_planar(const float *planes, size_t stride, size_t count)
+    {
+        if (!streaming)
+        {
+            audio_data.write_planar(audio_data.append(count), planes, stride, count);
+            return;
+        }
+        static const InterleaveKernel interleave = interleave_kernel(detect_simd_level());
+        for (size_t done = 0; done < count;)
+        {
+            size_t n = count - done < pending.space() ? count - done : pending.space();
+            interleave(planes, stride, channels, pending.tail(), done, n);
+            if (pending.commit(n))
+            {
+                flush_block();
+            }
+            done += n;
+        }
+    }
+
+    int get_channels() const { return channels; }
+    int get_sample_rate() const { return sample_rate; }
+    size_t frame_count() const { return audio_data.size(); }
+
+    // Add TPDF dither when converting to integer formats
+    // (reduces distortion of quiet signals at the cost of noise)
+    void set_dither(bool enabled) { use_dither = enabled; }
+
+    // View of one channel of buffered audio data
+    // for in-place processing (gain, pan, ...)
+    ChannelView channel(int channel)
+    {
+        return audio_data.channel(channel);
+    }
+
+    // Generate wave of given shape and frequency
+    // and add it to audio data (for given time)
+    void generate_wave(Waveform waveform, float frequency, float amplitude, float duration)
+    {
+        Oscillator oscillator(waveform, frequency, amplitude, sample_rate);
+        generate(oscillator, (size_t)ceil(duration * sample_rate));
+    }
+
+    // Generate sine wave with given frequency
+    // and add it to audio data (for given time)
+    void generate_sin(float frequency, float amplitude, float duration)
+    {
+        generate_wave(Waveform::Sine, frequency, amplitude, duration);
+    }
+
+    // Show range of audio data in console
+    // from start to end (frame indices), only
+    // frames kept in buffered mode can be shown
+    void show_range(int start, int end)
+    {
+        TextWriter out(std::cout);
+        FrameReader read = [this](size_t first, size_t count, float *frames) {
+            return read_float(first, count, frames);
+        };
+        write_frames_text(out, read, channels, start, end - start, ' ', false);
+    }
+
+    // Read buffered frames [first, first + count) as interleaved
+    // floats, returns number of read frames
+    size_t read_float(size_t first, size_t count, float *out) const
+    {
+        if (first >= audio_data.size())
+            return 0;
+        count = audio_data.size() - first < count ? audio_data.size() - first : count;
+        audio_data.interleave(out, first, count);
+        return count;
+    }
+
+    // Save audio data to wav file with
+    // path from constructor. Chunks are converted while
+    // the background thread writes the previous ones
+    void save()
+    {
+        std::cout << "Saving file: " << file_path << std::endl;
+        uint64_t data_size = (uint64_t)audio_data.size() * channels * bits_per_sample / 8;
+        if (data_size > max_data_size)
+            throw std::runtime_error("WAV data chunk would exceed 4 GiB");
+        // open file for asynchronous writing
+        AsyncWriter file(file_path);
+        // write headers to file
+        this->header = make_riff_header(sample_rate, channels, bits_per_sample, (uint32_t)data_size);
+        std::cout << "Data size: " << header.data_size << std::endl;
+        this->write_headers(file);
+        // write audio data to file, frames are
+        // interleaved in chunks on the way
+        std::vector<float> interleaved(BlockBuffer::block_frames * channels);
+        for (size_t first = 0; first < audio_data.size(); first += BlockBuffer::block_frames)
+        {
+            size_t n = audio_data.size() - first;
+            n = n < BlockBuffer::block_frames ? n : BlockBuffer::block_frames;
+            audio_data.interleave(interleaved.data(), first, n);
+            this->write_samples(file, interleaved.data(), n * channels);
+        }
+        this->write_pad(file, data_size);
+        // close file
+        file.close();
+    }
+};
+
+// Non-owning typed view of interleaved frames, points
+// straight into memory owned by someone else (no copy)
+template <typename T>
+struct FrameView
+{
+    const T *data = nullptr;                    // First sample of the first frame
+    size_t frames = 0;                          // Number of frames
+    int channels = 1;                           // Samples in one frame
+
+    size_t size() const { return frames * channels; }
+    const T *begin() const { return data; }
+    const T *end() const { return data + size(); }
+    const T *frame(size_t index) const { return data + index * channels; }
+    T at(size_t index, int channel) const { return data[index * channels + channel]; }
+
+    // View of frames [first, first + count)
+    FrameView<T> window(size_t first, size_t count) const
+    {
+        return FrameView<T>{data + first * channels, count, channels};
+    }
+};
+
+// Class for reading WAV files without loading them.
+// File is memory mapped, RIFF chunks are validated and the
+// "data" chunk is exposed as a typed view, so looking at any
+// window of a multi-GB recording touches only its pages
+class WavReader
+{
+private:
+    const char *file_path;                      // Path to file
+    const uint8_t *mapping = nullptr;           // Start of the mapped file
+    size_t mapping_size = 0;                    // Size of the mapped file in bytes
+#ifdef _WIN32
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping_handle = nullptr;
+#endif
+    const uint8_t *audio = nullptr;             // Start of "data" chunk
+    size_t audio_size = 0;                      // Size of "data" chunk in bytes
+    uint16_t format = 0;                        // 1 - PCM, 3 - IEEE float
+    int channels = 0;                           // Number of channels
+    int sample_rate = 0;                        // Sample rate in Hz
+    int bits_per_sample = 0;                    // Bits per sample
+
+    static uint32_t read_u32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+    static uint16_t read_u16(const uint8_t *p) { return p[0] | p[1] << 8; }
+
+    void map_file()
+    {
+#ifdef _WIN32
+        file_handle = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE)
+            throw std::runtime_error(std::string("Can't open file: ") + file_path);
+        LARGE_INTEGER size;
+        GetFileSizeEx(file_handle, &size);
+        mapping_size = (size_t)size.QuadPart;
+        mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_handle == nullptr)
+            throw std::runtime_error(std::string("Can't map file: ") + file_path);
+        mapping = (const uint8_t *)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = open(file_path, O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error(std::string("Can't open file: ") + file_path);
+        struct stat info;
+        fstat(fd, &info);
+        mapping_size = (size_t)info.st_size;
+        void *address = mapping_size ? mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        // mapping keeps its own reference to the file
+        close(fd);
+        mapping = address == MAP_FAILED ? nullptr : (const uint8_t *)address;
+#endif
+        if (mapping == nullptr)
+            throw std::runtime_error(std::string("Can't map file: ") + file_path);
+    }
+
+    void unmap_file()
+    {
+#ifdef _WIN32
+        if (mapping)
+            UnmapViewOfFile(mapping);
+        if (mapping_handle)
+            CloseHandle(mapping_handle);
+        if (file_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(file_handle);
+#else
+        if (mapping)
+            munmap((void *)mapping, mapping_size);
+#endif
+    }
+
+    // Walk over RIFF chunks, read "fmt " and find "data",
+    // unknown chunks (LIST, fact, ...) are skipped
+    void parse_chunks()
+    {
+        if (mapping_size < 12 || memcmp(mapping, "RIFF", 4) != 0 || memcmp(mapping + 8, "WAVE", 4) != 0)
+            throw std::runtime_error(std::string("Not a RIFF/WAVE file: ") + file_path);
+        size_t offset = 12;
+        bool has_fmt = false;
+        int block_align = 0;
+        while (offset + 8 <= mapping_size)
+        {
+            const uint8_t *chunk = mapping + offset;
+            size_t size = read_u32(chunk + 4);
+            const uint8_t *body = chunk + 8;
+            size_t available = mapping_size - offset - 8;
+            if (memcmp(chunk, "fmt ", 4) == 0)
+            {
+                if (size < 16 || size > available)
+                    throw std::runtime_error("Broken fmt chunk");
+                format = read_u16(body);
+                channels = read_u16(body + 2);
+                sample_rate = (int)read_u32(body + 4);
+                block_align = read_u16(body + 12);
+                bits_per_sample = read_u16(body + 14);
+                // WAVE_FORMAT_EXTENSIBLE keeps real format in sub format GUID
+                if (format == 0xFFFE && size >= 26)
+                    format = read_u16(body + 24);
+                has_fmt = true;
+            }
+            else if (memcmp(chunk, "data", 4) == 0)
+            {
+                // writers that could not patch the size leave it too big
+                audio = body;
+                audio_size = size < available ? size : available;
+                break;
+            }
+            // chunks are padded to even size
+            offset += 8 + size + (size & 1);
+        }
+        if (!has_fmt || audio == nullptr)
+            throw std::runtime_error(std::string("No fmt or data chunk in: ") + file_path);
+        if (channels == 0)
+            throw std::runtime_error("Zero channels in fmt chunk");
+        // frame size is used as divisor, so broken values must not get through
+        if (bits_per_sample != 8 && bits_per_sample != 16 && bits_per_sample != 24 && bits_per_sample != 32)
+            throw std::runtime_error("Unsupported bits per sample in fmt chunk");
+        if (block_align != channels * bits_per_sample / 8)
+            throw std::runtime_error("Block align does not match channels and bits per sample");
+    }
+
+    template <typename T>
+    FrameView<T> view(uint16_t expected_format) const
+    {
+        if (format != expected_format || bits_per_sample != 8 * sizeof(T))
+            throw std::runtime_error("Requested sample type does not match file format");
+        if ((uintptr_t)audio % alignof(T) != 0)
+            throw std::runtime_error("Data chunk is not aligned for zero-copy view");
+        return FrameView<T>{(const T *)audio, audio_size / (sizeof(T) * channels), channels};
+    }
+
+public:
+    WavReader(const char *file_path)
+    {
+        this->file_path = file_path;
+        map_file();
+        try
+        {
+            parse_chunks();
+        }
+        catch (...)
+        {
+            unmap_file();
+            throw;
+        }
+    }
+
+    WavReader(const WavReader &) = delete;
+    WavReader &operator=(const WavReader &) = delete;
+
+    ~WavReader()
+    {
+        unmap_file();
+    }
+
+    int get_channels() const { return channels; }
+    int get_sample_rate() const { return sample_rate; }
+    int get_bits_per_sample() const { return bits_per_sample; }
+    bool is_float() const { return format == 3; }
+    size_t frame_count() const { return audio_size / (channels * bits_per_sample / 8); }
+    SampleFormat get_sample_format() const { return sample_format(bits_per_sample, is_float()); }
+
+    // Read frames [first, first + count) of any format as
+    // interleaved floats, returns number of read frames
+    size_t read_float(size_t first, size_t count, float *out) const
+    {
+        size_t frames = frame_count();
+        if (first >= frames)
+            return 0;
+        count = frames - first < count ? frames - first : count;
+        size_t frame_size = channels * bits_per_sample / 8;
+        samples_to_float((const char *)audio + first * frame_size, count * channels, get_sample_format(), out);
+        return count;
+    }
+
+    // Zero-copy views of the "data" chunk,
+    // throw if file has another sample format
+    FrameView<int16_t> samples_int16() const { return view<int16_t>(1); }
+    FrameView<float> samples_float() const { return view<float>(3); }
+
+    // Hint kernel that file will be read from start to end,
+    // so it reads ahead and drops pages behind
+    void advise_sequential() const
+    {
+#ifndef _WIN32
+        madvise((void *)mapping, mapping_size, MADV_SEQUENTIAL);
+#endif
+    }
+
+    // Ask kernel to load pages of frames [first, first + count)
+    // in advance, range is widened to page boundaries
+    void prefetch(size_t first, size_t count) const
+    {
+#ifndef _WIN32
+        size_t frame_size = channels * bits_per_sample / 8;
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t begin = (audio - mapping) + first * frame_size;
+        size_t end = begin + count * frame_size;
+        end = end < mapping_size ? end : mapping_size;
+        begin -= begin % page;
+        if (begin < end)
+            madvise((void *)(mapping + begin), end - begin, MADV_WILLNEED);
+#endif
+    }
+
+    // Show range of frames in console from start
+    // to end (frame indices), only touched pages are read
+    void show_range(size_t start, size_t end) const
+    {
+        end = end < frame_count() ? end : frame_count();
+        if (start >= end)
+            return;
+        prefetch(start, end - start);
+        TextWriter out(std::cout);
+        FrameReader read = [this](size_t first, size_t count, float *frames) {
+            return read_float(first, count, frames);
+        };
+        write_frames_text(out, read, channels, start, end - start, ' ', false);
+    }
+};
+
+// Fixed pool of worker threads. parallel_for() runs body for
+// every index in [0, count), indices are taken from a shared
+// counter, the calling thread works as worker 0
+class ThreadPool
+{
+private:
+    std::vector<std::thread> threads;           // Workers 1..size()-1
+    std::mutex mutex;
+    std::condition_variable wake;               // Signals new job or stop
+    std::condition_variable finished;           // Signals that workers are done with the job
+    const std::function<void(size_t, size_t)> *job = nullptr;
+    size_t job_size = 0;                        // Number of indices in the job
+    std::atomic<size_t> next_index{0};          // Next index to process
+    size_t generation = 0;                      // Incremented for every job
+    size_t busy = 0;                            // Workers still running the job
+    std::exception_ptr job_error;               // First error thrown by body
+    bool stopping = false;
+
+    // Error of body is kept for parallel_for, the
+    // remaining indices are skipped
+    void run_job(size_t worker)
+    {
+        try
+        {
+            for (size_t index = next_index++; index < job_size; index = next_index++)
+            {
+                (*job)(index, worker);
+            }
+        }
+        catch (...)
+        {
+            next_index = job_size;
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!job_error)
+                job_error = std::current_exception();
+        }
+    }
+
+    void worker_loop(size_t worker)
+    {
+        size_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            run_job(worker);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0)
+                finished.notify_one();
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t workers = std::thread::hardware_concurrency())
+    {
+        workers = workers ? workers : 1;
+        for (size_t i = 1; i < workers; i++)
+        {
+            threads.emplace_back(&ThreadPool::worker_loop, this, i);
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    // Number of workers including calling thread
+    size_t size() const { return threads.size() + 1; }
+
+    // Call body(index, worker) for every index, returns when all are done.
+    // Optional serial task runs on the calling thread before it joins
+    // the job, so it overlaps with the other workers. Errors of serial
+    // and body are thrown after all workers have left the job
+    void parallel_for(size_t count, const std::function<void(size_t index, size_t worker)> &body,
+                      const std::function<void()> &serial = nullptr)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &body;
+            job_size = count;
+            next_index = 0;
+            busy = threads.size();
+            job_error = nullptr;
+            generation++;
+        }
+        wake.notify_all();
+        // workers use body until the job is done, so errors
+        // are thrown only after that
+        std::exception_ptr serial_error;
+        if (serial)
+        {
+            try
+            {
+                serial();
+            }
+            catch (...)
+            {
+                serial_error = std::current_exception();
+            }
+        }
+        run_job(0);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&] { return busy == 0; });
+            job = nullptr;
+        }
+        if (serial_error)
+            std::rethrow_exception(serial_error);
+        if (job_error)
+            std::rethrow_exception(job_error);
+    }
+};
+
+// Render graph: sources (oscillators, files) feed gain, pan and
+// mix nodes, the output node is pulled block by block. Every node
+// renders any block from its absolute frame index only, without
+// state left from previous blocks, so blocks can be rendered by
+// different threads in any order and the result is bit-identical
+// to a single-threaded render
+const size_t render_block_frames = 4096;        // Frames in one render block
+
+// Per-thread scratch memory, used as a stack: node takes a
+// buffer for its input and gives it back when it is done
+class RenderScratch
+{
+private:
+    std::vector<std::vector<float, AlignedAllocator<float>>> buffers;
+    size_t used = 0;                            // Buffers currently taken
+
+public:
+    // Buffer for planar block of given channel count
+    float *take(int channels)
+    {
+        if (used == buffers.size())
+            buffers.emplace_back();
+        std::vector<float, AlignedAllocator<float>> &buffer = buffers[used++];
+        if (buffer.size() < render_block_frames * channels)
+            buffer.resize(render_block_frames * channels);
+        return buffer.data();
+    }
+
+    void give_back() { used--; }
+};
+
+// Node of render graph. Output is planar: channel c of the
+// block is written to out + c * render_block_frames
+class RenderNode
+{
+public:
+    virtual ~RenderNode() {}
+
+    // Number of channels this node produces
+    virtual int channels() const = 0;
+
+    // Render frames [first, first + count), count <= render_block_frames
+    virtual void render(size_t first, size_t count, float *out, RenderScratch &scratch) const = 0;
+};
+
+class OscillatorSource : public RenderNode
+{
+private:
+    Oscillator oscillator;
 
-    // Function for writing wav headers to the
-    // start of the current file
-    void write_headers(std::ofstream &file)
+public:
+    OscillatorSource(Waveform waveform, float frequency, float amplitude, int sample_rate)
+        : oscillator(waveform, frequency, amplitude, sample_rate) {}
+
+    int channels() const override { return 1; }
+
+    void render(size_t first, size_t count, float *out, RenderScratch &) const override
     {
-        file.write(this->header.riff, 4);      // "RIFF" header
-        file.write(header.file_size, 4);       // file size
-        file.write(header.wave_fmt, 8);        // "WAVEfmt " to indentify file as wav
-        file.write(header.fmt_size, 4);        // size of the fmt chunk
-        file.write(header.fmt_type, 2);        // format type
-        file.write(header.channels, 2);        // number of channels
-        file.write(header.sample_rate, 4);     // sample rate
-        file.write(header.byte_rate, 4);       // byte rate
-        file.write(header.block_align, 2);     // block align
-        file.write(header.bits_per_sample, 2); // bits per sample
-        file.write(header.data, 4);            // write "data" header, containing all audio data
-        file.write(header.data_size, 4);       // write size of audio data
+        oscillator.fill_at(out, first, count);
     }
+};
+
+// Source reading 16-bit or float WAV file through the
+// mapped view, frames after the end of file are silent
+class FileSource : public RenderNode
+{
+private:
+    const WavReader &reader;
+    int file_channels;
 
 public:
-    // Constructor for creating new wav file
-    WavFile(const char *file_path, int sample_rate, int channels, int bits_per_sample)
+    FileSource(const WavReader &reader) : reader(reader), file_channels(reader.get_channels())
     {
-        this->file_path = file_path;
-        this->sample_rate = sample_rate;
-        this->channels = channels;
-        this->bits_per_sample = bits_per_sample;
+        if (!reader.is_float() && reader.get_bits_per_sample() != 16)
+            throw std::runtime_error("FileSource supports 16-bit and float files only");
     }
 
-    // Sample new audio data
-    void sample(float* sample)
+    int channels() const override { return file_channels; }
+
+    void render(size_t first, size_t count, float *out, RenderScratch &) const override
     {
-        audio_data.push_back(sample);
+        size_t frames = reader.frame_count();
+        size_t available = first < frames ? (frames - first < count ? frames - first : count) : 0;
+        for (int channel = 0; channel < file_channels; channel++)
+        {
+            float *plane = out + channel * render_block_frames;
+            if (reader.is_float())
+            {
+                FrameView<float> view = reader.samples_float();
+                for (size_t i = 0; i < available; i++)
+                    plane[i] = view.at(first + i, channel);
+            }
+            else
+            {
+                FrameView<int16_t> view = reader.samples_int16();
+                for (size_t i = 0; i < available; i++)
+                    plane[i] = view.at(first + i, channel) / 32768.0f;
+            }
+            std::fill(plane + available, plane + count, 0.0f);
+        }
     }
+};
 
-    // Generate sine wave with given frequency
-    // and add it to audio data (for given time)
-    void generate_sin(float frequency, float amplitude, float duration)
+class GainNode : public RenderNode
+{
+private:
+    const RenderNode &input;
+    float gain;
+
+public:
+    GainNode(const RenderNode &input, float gain) : input(input), gain(gain) {}
+
+    int channels() const override { return input.channels(); }
+
+    void render(size_t first, size_t count, float *out, RenderScratch &scratch) const override
     {
-        for (int i = 0; i < duration * sample_rate; i++)
+        input.render(first, count, out, scratch);
+        for (int channel = 0; channel < channels(); channel++)
         {
-            float sample = amplitude * sin(2 * M_PI * frequency * i / sample_rate);
-            audio_data.push_back(sample);
+            float *plane = out + channel * render_block_frames;
+            for (size_t i = 0; i < count; i++)
+                plane[i] *= gain;
         }
     }
+};
 
-    // Show range of audio data in console
-    // from start to end (in seconds)
-    void show_range(int start, int end)
+// Constant-power pan of mono input to stereo,
+// pan is -1 (left) .. 1 (right)
+class PanNode : public RenderNode
+{
+private:
+    const RenderNode &input;
+    float left_gain;
+    float right_gain;
+
+public:
+    PanNode(const RenderNode &input, float pan) : input(input)
+    {
+        if (input.channels() != 1)
+            throw std::runtime_error("PanNode needs mono input");
+        double angle = (pan + 1) * M_PI / 4;
+        left_gain = (float)cos(angle);
+        right_gain = (float)sin(angle);
+    }
+
+    int channels() const override { return 2; }
+
+    void render(size_t first, size_t count, float *out, RenderScratch &scratch) const override
     {
-        for (int i = start; i < end; i++)
+        input.render(first, count, out, scratch);
+        float *left = out;
+        float *right = out + render_block_frames;
+        for (size_t i = 0; i < count; i++)
         {
-            std::cout << audio_data[i] << std::endl;
+            right[i] = left[i] * right_gain;
+            left[i] *= left_gain;
         }
     }
+};
 
-    // Save audio data to wav file with
-    // path from constructor
-    void save()
+// Sum of inputs, mono inputs are added to every
+// channel. Inputs are always added in the same order
+class MixNode : public RenderNode
+{
+private:
+    std::vector<const RenderNode *> inputs;
+    int mix_channels;
+
+public:
+    MixNode(std::vector<const RenderNode *> inputs, int channels) : inputs(inputs), mix_channels(channels)
     {
-        std::cout << "Saving file: " << file_path << std::endl;
-        // open file in binary mode
-        std::ofstream file(file_path, std::ios::binary);
-        // write headers to file
-        this->header.data_size = (char *)(sizeof(float) * audio_data.size());
-        std::cout << "Data size: " << header.data_size << std::endl;
-        this->write_headers(file);
-        // write audio data to file
-        file.write((char *)this->audio_data.data(), sizeof(float) * this->audio_data.size());
-        // close file
+        for (const RenderNode *input : inputs)
+        {
+            if (input->channels() != 1 && input->channels() != channels)
+                throw std::runtime_error("MixNode input has wrong number of channels");
+        }
+    }
+
+    int channels() const override { return mix_channels; }
+
+    void render(size_t first, size_t count, float *out, RenderScratch &scratch) const override
+    {
+        for (int channel = 0; channel < mix_channels; channel++)
+            std::fill(out + channel * render_block_frames, out + channel * render_block_frames + count, 0.0f);
+        float *block = scratch.take(mix_channels);
+        for (const RenderNode *input : inputs)
+        {
+            input->render(first, count, block, scratch);
+            for (int channel = 0; channel < mix_channels; channel++)
+            {
+                const float *source = block + (input->channels() == 1 ? 0 : channel * render_block_frames);
+                float *plane = out + channel * render_block_frames;
+                for (size_t i = 0; i < count; i++)
+                    plane[i] += source[i];
+            }
+        }
+        scratch.give_back();
+    }
+};
+
+// Owner of render nodes, builder methods return nodes
+// that can be used as inputs of the following ones
+class RenderGraph
+{
+private:
+    std::vector<std::unique_ptr<RenderNode>> nodes;
+
+    template <typename Node, typename... Args>
+    const RenderNode &add(Args &&...args)
+    {
+        nodes.push_back(std::unique_ptr<RenderNode>(new Node(std::forward<Args>(args)...)));
+        return *nodes.back();
+    }
+
+public:
+    const RenderNode &oscillator(Waveform waveform, float frequency, float amplitude, int sample_rate)
+    {
+        return add<OscillatorSource>(waveform, frequency, amplitude, sample_rate);
+    }
+    const RenderNode &file(const WavReader &reader) { return add<FileSource>(reader); }
+    const RenderNode &gain(const RenderNode &input, float gain) { return add<GainNode>(input, gain); }
+    const RenderNode &pan(const RenderNode &input, float pan) { return add<PanNode>(input, pan); }
+    const RenderNode &mix(std::vector<const RenderNode *> inputs, int channels)
+    {
+        return add<MixNode>(inputs, channels);
+    }
+
+    // Render frames of output node to the file. Batches of blocks
+    // are rendered in parallel and appended in order, so this works
+    // for both buffered and streaming mode. Two batch buffers are
+    // used: while workers render one batch, calling thread appends
+    // the previous one
+    void render(const RenderNode &output, size_t frames, WavFile &file, ThreadPool &pool) const
+    {
+        int channels = output.channels();
+        if (channels != file.get_channels())
+            throw std::runtime_error("Output node and file have different number of channels");
+        size_t block_size = render_block_frames * channels;
+        size_t batch = pool.size() * 4;
+        std::vector<float, AlignedAllocator<float>> blocks[2];
+        blocks[0].resize(batch * block_size);
+        blocks[1].resize(batch * block_size);
+        std::vector<RenderScratch> scratch(pool.size());
+        auto block_frames = [&](size_t start) {
+            return frames - start < render_block_frames ? frames - start : render_block_frames;
+        };
+        // append batch starting at frame first from buffer
+        auto append = [&](size_t first, const float *buffer) {
+            for (size_t start = first; start < frames && start < first + batch * render_block_frames;
+                 start += render_block_frames)
+            {
+                file.append_planar(buffer + (start - first) / render_block_frames * block_size,
+                                   render_block_frames, block_frames(start));
+            }
+        };
+        size_t step = batch * render_block_frames;
+        size_t current = 0;
+        for (size_t first = 0; first < frames; first += step, current ^= 1)
+        {
+            size_t left = frames - first;
+            size_t count = (left + render_block_frames - 1) / render_block_frames;
+            count = count < batch ? count : batch;
+            float *target = blocks[current].data();
+            std::function<void()> previous;
+            if (first > 0)
+                previous = [&, first] { append(first - step, blocks[current ^ 1].data()); };
+            pool.parallel_for(count, [&](size_t index, size_t worker) {
+                size_t start = first + index * render_block_frames;
+                output.render(start, block_frames(start), target + index * block_size, scratch[worker]);
+            }, previous);
+        }
+        if (frames > 0)
+            append((frames - 1) / step * step, blocks[current ^ 1].data());
+    }
+};
+
+// Measure max error of every available oscillator
+// path against std::sin over a few seconds of audio
+void check_oscillator_accuracy()
+{
+    const int sample_rate = 44100;
+    const size_t count = sample_rate * 10;
+    const float frequency = 440.0f;
+    std::vector<float> out(count);
+    SimdLevel best = detect_simd_level();
+    for (int level = 0; level <= (int)best; level++)
+    {
+        Oscillator oscillator(Waveform::Sine, frequency, 1.0f, sample_rate, (SimdLevel)level);
+        oscillator.fill(out.data(), count);
+        double max_error = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            double expected = sin(2 * M_PI * fmod((double)frequency * i / sample_rate, 1.0));
+            max_error = fmax(max_error, fabs(out[i] - expected));
+        }
+        std::cout << "Sine max error (" << simd_level_name((SimdLevel)level) << "): " << max_error << "\n";
+    }
+}
+
+// Compare samples/second of scalar and SIMD oscillator paths
+void benchmark_oscillators()
+{
+    const size_t block = 4096;
+    const size_t total = 1 << 24;
+    std::vector<float> out(block);
+    SimdLevel best = detect_simd_level();
+    for (int level = 0; level <= (int)best; level++)
+    {
+        Oscillator oscillator(Waveform::Sine, 440.0f, 0.5f, 44100, (SimdLevel)level);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t done = 0; done < total; done += block)
+        {
+            oscillator.fill(out.data(), block);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Oscillator (" << simd_level_name((SimdLevel)level) << "): "
+                  << total / elapsed.count() / 1e6 << " M samples/s (check " << out[block - 1] << ")\n";
+    }
+}
+
+// Radix-2 FFT stage kernels work on complex numbers kept as two
+// arrays (split format): re[], im[]. Every stage of size m uses
+// its own contiguous twiddle table w_k = exp(-2*pi*i*k/m), k < m/2,
+// stored at offset m/2, so SIMD code loads 8 twiddles at once
+typedef void (*FftStageKernel)(float *re, float *im, size_t n, size_t half,
+                               const float *twiddle_re, const float *twiddle_im);
+
+void fft_stage_scalar(float *re, float *im, size_t n, size_t half,
+                      const float *twiddle_re, const float *twiddle_im)
+{
+    for (size_t start = 0; start < n; start += 2 * half)
+    {
+        for (size_t k = 0; k < half; k++)
+        {
+            size_t a = start + k;
+            size_t b = a + half;
+            float tr = re[b] * twiddle_re[k] - im[b] * twiddle_im[k];
+            float ti = re[b] * twiddle_im[k] + im[b] * twiddle_re[k];
+            re[b] = re[a] - tr;
+            im[b] = im[a] - ti;
+            re[a] += tr;
+            im[a] += ti;
+        }
+    }
+}
+
+#ifdef WAV_X86
+TARGET_AVX2 void fft_stage_avx2(float *re, float *im, size_t n, size_t half,
+                                const float *twiddle_re, const float *twiddle_im)
+{
+    if (half < 8)
+    {
+        fft_stage_scalar(re, im, n, half, twiddle_re, twiddle_im);
+        return;
+    }
+    for (size_t start = 0; start < n; start += 2 * half)
+    {
+        for (size_t k = 0; k < half; k += 8)
+        {
+            size_t a = start + k;
+            size_t b = a + half;
+            __m256 wr = _mm256_loadu_ps(twiddle_re + k);
+            __m256 wi = _mm256_loadu_ps(twiddle_im + k);
+            __m256 br = _mm256_loadu_ps(re + b);
+            __m256 bi = _mm256_loadu_ps(im + b);
+            __m256 tr = _mm256_fmsub_ps(br, wr, _mm256_mul_ps(bi, wi));
+            __m256 ti = _mm256_fmadd_ps(br, wi, _mm256_mul_ps(bi, wr));
+            __m256 ar = _mm256_loadu_ps(re + a);
+            __m256 ai = _mm256_loadu_ps(im + a);
+            _mm256_storeu_ps(re + b, _mm256_sub_ps(ar, tr));
+            _mm256_storeu_ps(im + b, _mm256_sub_ps(ai, ti));
+            _mm256_storeu_ps(re + a, _mm256_add_ps(ar, tr));
+            _mm256_storeu_ps(im + a, _mm256_add_ps(ai, ti));
+        }
+    }
+}
+#endif
+
+FftStageKernel fft_stage_kernel(SimdLevel level)
+{
+#ifdef WAV_X86
+    if (level == SimdLevel::AVX2)
+        return fft_stage_avx2;
+#endif
+    return fft_stage_scalar;
+}
+
+// Buffers of one FFT call, every thread keeps its own
+// workspace, so transforms do not allocate memory
+struct FftWorkspace
+{
+    std::vector<float, AlignedAllocator<float>> re;
+    std::vector<float, AlignedAllocator<float>> im;
+};
+
+// FFT of real input of size N (power of two, at least 16).
+// Input is packed into N/2 complex numbers (even samples as real
+// part, odd as imaginary), transformed with complex FFT (first two
+// stages fused into one radix-4 pass, the rest are radix-2 SIMD
+// stages) and then split into N/2 + 1 bins of the real spectrum.
+// All twiddles and bit-reversal indices are computed once
+class RealFFT
+{
+private:
+    size_t size;                                // N - number of real input samples
+    size_t half;                                // N/2 - size of complex transform
+    std::vector<uint32_t> reversed;             // Bit-reversed index of every complex input
+    std::vector<float, AlignedAllocator<float>> twiddle_re;  // Stage twiddles, see FftStageKernel
+    std::vector<float, AlignedAllocator<float>> twiddle_im;
+    std::vector<float> split_re;                // exp(-2*pi*i*k/N) for the real split
+    std::vector<float> split_im;
+    FftStageKernel stage = fft_stage_kernel(detect_simd_level());
+
+public:
+    explicit RealFFT(size_t size) : size(size), half(size / 2)
+    {
+        if (size < 16 || (size & (size - 1)) != 0)
+            throw std::runtime_error("FFT size must be a power of two >= 16");
+        int bits = 0;
+        while (((size_t)1 << bits) < half)
+            bits++;
+        reversed.resize(half);
+        for (size_t i = 0; i < half; i++)
+        {
+            uint32_t r = 0;
+            for (int b = 0; b < bits; b++)
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            reversed[i] = r;
+        }
+        twiddle_re.resize(half);
+        twiddle_im.resize(half);
+        for (size_t h = 1; h < half; h *= 2)
+        {
+            for (size_t k = 0; k < h; k++)
+            {
+                twiddle_re[h + k] = (float)cos(-M_PI * k / h);
+                twiddle_im[h + k] = (float)sin(-M_PI * k / h);
+            }
+        }
+        split_re.resize(half);
+        split_im.resize(half);
+        for (size_t k = 0; k < half; k++)
+        {
+            split_re[k] = (float)cos(-2 * M_PI * k / size);
+            split_im[k] = (float)sin(-2 * M_PI * k / size);
+        }
+    }
+
+    size_t get_size() const { return size; }
+    size_t bins() const { return half + 1; }
+
+    // Transform size real samples, out_re/out_im get bins() values
+    void transform(const float *input, float *out_re, float *out_im, FftWorkspace &work) const
+    {
+        work.re.resize(half);
+        work.im.resize(half);
+        float *re = work.re.data();
+        float *im = work.im.data();
+        for (size_t i = 0; i < half; i++)
+        {
+            re[reversed[i]] = input[2 * i];
+            im[reversed[i]] = input[2 * i + 1];
+        }
+        // stages of size 2 and 4 as one radix-4 butterfly
+        for (size_t i = 0; i < half; i += 4)
+        {
+            float a0r = re[i] + re[i + 1], a0i = im[i] + im[i + 1];
+            float a1r = re[i] - re[i + 1], a1i = im[i] - im[i + 1];
+            float a2r = re[i + 2] + re[i + 3], a2i = im[i + 2] + im[i + 3];
+            float a3r = re[i + 2] - re[i + 3], a3i = im[i + 2] - im[i + 3];
+            // a3 * -i
+            float tr = a3i, ti = -a3r;
+            re[i] = a0r + a2r, im[i] = a0i + a2i;
+            re[i + 2] = a0r - a2r, im[i + 2] = a0i - a2i;
+            re[i + 1] = a1r + tr, im[i + 1] = a1i + ti;
+            re[i + 3] = a1r - tr, im[i + 3] = a1i - ti;
+        }
+        for (size_t h = 4; h < half; h *= 2)
+        {
+            stage(re, im, half, h, twiddle_re.data() + h, twiddle_im.data() + h);
+        }
+        // split packed transform into spectrum of real input
+        out_re[0] = re[0] + im[0];
+        out_im[0] = 0;
+        out_re[half] = re[0] - im[0];
+        out_im[half] = 0;
+        for (size_t k = 1; k < half; k++)
+        {
+            float zr = re[k], zi = im[k];
+            float cr = re[half - k], ci = -im[half - k];
+            float er = (zr + cr) * 0.5f, ei = (zi + ci) * 0.5f;
+            // (z - c) / 2i
+            float orr = (zi - ci) * 0.5f, oi = -(zr - cr) * 0.5f;
+            out_re[k] = er + orr * split_re[k] - oi * split_im[k];
+            out_im[k] = ei + orr * split_im[k] + oi * split_re[k];
+        }
+    }
+};
+
+// Power spectrum of audio over time: one row of
+// bins (in dB) for every analysis frame
+struct Spectrogram
+{
+    size_t frames = 0;                          // Number of rows
+    size_t bins = 0;                            // Values in one row
+    int sample_rate = 0;                        // Sample rate of analyzed audio
+    size_t fft_size = 0;                        // Samples in one frame
+    std::vector<float> power;                   // frames * bins values in dB
+
+    const float *row(size_t frame) const { return power.data() + frame * bins; }
+    double bin_frequency(size_t bin) const { return (double)bin * sample_rate / fft_size; }
+};
+
+// Short-time Fourier transform with Hann window. Frames are
+// transformed in parallel on ThreadPool, every worker has its
+// own workspace and writes straight to its row of the result,
+// so no memory is allocated per frame
+class STFT
+{
+private:
+    RealFFT fft;
+    size_t hop;                                 // Samples between starts of frames
+    std::vector<float> window;                  // Hann window, normalized to unit gain
+    std::vector<FftWorkspace> workspaces;       // One per worker
+    std::vector<std::vector<float>> buffers;    // Windowed frame and spectrum, one per worker
+
+    void prepare(size_t workers)
+    {
+        size_t size = fft.get_size();
+        workspaces.resize(workers);
+        buffers.resize(workers);
+        for (std::vector<float> &buffer : buffers)
+            buffer.resize(size + 2 * fft.bins());
+    }
+
+    // Transform one frame of samples given by accessor into row
+    template <typename Samples>
+    void transform(const Samples &samples, size_t start, float *row, size_t worker)
+    {
+        size_t size = fft.get_size();
+        size_t bins = fft.bins();
+        float *frame = buffers[worker].data();
+        float *out_re = frame + size;
+        float *out_im = out_re + bins;
+        for (size_t i = 0; i < size; i++)
+            frame[i] = samples(start + i) * window[i];
+        fft.transform(frame, out_re, out_im, workspaces[worker]);
+        for (size_t k = 0; k < bins; k++)
+            row[k] = 10.0f * log10f(out_re[k] * out_re[k] + out_im[k] * out_im[k] + 1e-20f);
+    }
+
+public:
+    STFT(size_t fft_size, size_t hop) : fft(fft_size), hop(hop), window(fft_size)
+    {
+        double sum = 0;
+        for (size_t i = 0; i < fft_size; i++)
+        {
+            window[i] = (float)(0.5 - 0.5 * cos(2 * M_PI * i / fft_size));
+            sum += window[i];
+        }
+        // full-scale sine gives 0 dB peak
+        for (float &value : window)
+            value = (float)(value * 2 / sum);
+    }
+
+    // Spectrogram of one channel of buffered audio
+    Spectrogram analyze(ChannelView channel, int sample_rate, ThreadPool &pool)
+    {
+        Spectrogram result;
+        result.sample_rate = sample_rate;
+        result.fft_size = fft.get_size();
+        result.bins = fft.bins();
+        result.frames = channel.size() < fft.get_size() ? 0 : (channel.size() - fft.get_size()) / hop + 1;
+        result.power.resize(result.frames * result.bins);
+        prepare(pool.size());
+        auto samples = [&](size_t index) { return channel[index]; };
+        pool.parallel_for(result.frames, [&](size_t frame, size_t worker) {
+            transform(samples, frame * hop, result.power.data() + frame * result.bins, worker);
+        });
+        return result;
+    }
+
+    // Spectrogram of one channel of mapped file, computed in
+    // batches of rows, every batch is given to callback as
+    // (first frame, number of frames, rows), so memory usage
+    // does not depend on file length
+    void analyze(const WavReader &reader, int channel, ThreadPool &pool,
+                 const std::function<void(size_t, size_t, const float *)> &callback, size_t batch = 256)
+    {
+        if (channel < 0 || channel >= reader.get_channels())
+            throw std::out_of_range("Channel out of range: " + std::to_string(channel));
+        size_t size = fft.get_size();
+        size_t bins = fft.bins();
+        size_t total = reader.frame_count();
+        size_t frames = total < size ? 0 : (total - size) / hop + 1;
+        int channels = reader.get_channels();
+        size_t span = (batch - 1) * hop + size;
+        std::vector<float> interleaved(span * channels);
+        std::vector<float> mono(span);
+        std::vector<float> rows(batch * bins);
+        prepare(pool.size());
+        reader.advise_sequential();
+        for (size_t first = 0; first < frames; first += batch)
+        {
+            size_t count = frames - first < batch ? frames - first : batch;
+            size_t read = reader.read_float(first * hop, (count - 1) * hop + size, interleaved.data());
+            for (size_t i = 0; i < read; i++)
+                mono[i] = interleaved[i * channels + channel];
+            auto samples = [&](size_t index) { return mono[index]; };
+            pool.parallel_for(count, [&](size_t frame, size_t worker) {
+                transform(samples, frame * hop, rows.data() + frame * bins, worker);
+            });
+            callback(first, count, rows.data());
+        }
+    }
+};
+
+// Export of audio data for other tools. Data is taken through
+// FrameReader, so it works for buffered WavFile and mapped files
+FrameReader frame_reader(const WavFile &file)
+{
+    return [&file](size_t first, size_t count, float *out) { return file.read_float(first, count, out); };
+}
+
+FrameReader frame_reader(const WavReader &reader)
+{
+    return [&reader](size_t first, size_t count, float *out) { return reader.read_float(first, count, out); };
+}
+
+// CSV with "frame,ch0,ch1,..." header and one line per frame
+void export_csv(const char *path, const FrameReader &read, int channels, size_t frames)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error(std::string("Can't open file: ") + path);
+    TextWriter out(file, 1 << 20);
+    out.put("frame");
+    for (int channel = 0; channel < channels; channel++)
+    {
+        out.put(",ch");
+        out.put((uint64_t)channel);
+    }
+    out.put('\n');
+    write_frames_text(out, read, channels, 0, frames, ',', true);
+    out.flush();
+    file.close();
+    if (!file)
+        throw std::runtime_error(std::string("Write failed: ") + path);
+}
+
+// Raw interleaved little-endian float32 samples without header
+void export_raw(const char *path, const FrameReader &read, int channels, size_t frames)
+{
+    AsyncWriter file(path);
+    const size_t chunk = 16384;
+    std::vector<float> samples(chunk * channels);
+    for (size_t first = 0; first < frames;)
+    {
+        size_t n = read(first, frames - first < chunk ? frames - first : chunk, samples.data());
+        if (n == 0)
+            break;
+        file.write((const char *)samples.data(), sizeof(float) * n * channels);
+        first += n;
+    }
+    file.close();
+}
+
+// Header of waveform overview file: levels table follows it,
+// then data of every level as (min, max) float pairs for every
+// bucket and channel. Bucket of level i covers base << i frames
+#pragma pack(push, 1)
+struct OverviewHeader
+{
+    char magic[4];                              // "WOVR"
+    uint32_t version;                           // Format version (1)
+    uint32_t sample_rate;                       // Sample rate of source audio
+    uint32_t channels;                          // Number of channels
+    uint64_t frames;                            // Number of frames in source audio
+    uint32_t base;                              // Frames in bucket of level 0
+    uint32_t levels;                            // Number of levels
+};
+
+struct OverviewLevel
+{
+    uint64_t offset;                            // Offset of level data in file
+    uint64_t buckets;                           // Number of buckets in level
+};
+#pragma pack(pop)
+
+static_assert(sizeof(OverviewHeader) == 32, "overview header must be 32 bytes");
+static_assert(sizeof(OverviewLevel) == 16, "overview level entry must be 16 bytes");
+
+// Min/max "waveform overview" pyramid, like mipmaps of a texture:
+// level 0 has one (min, max) pair per base frames and channel,
+// every next level merges pairs of buckets of the previous one.
+// Dashboard picks level by zoom and reads only that level
+class WaveformOverview
+{
+private:
+    int channels = 0;
+    int sample_rate = 0;
+    size_t frames = 0;
+    size_t base = 0;
+    std::vector<std::vector<float>> levels;     // Per level: buckets * channels * (min, max)
+
+public:
+    // Scan audio once and build all levels
+    WaveformOverview(const FrameReader &read, int channels, int sample_rate, size_t frames, size_t base = 256)
+        : channels(channels), sample_rate(sample_rate), frames(frames), base(base)
+    {
+        size_t buckets = (frames + base - 1) / base;
+        levels.emplace_back(buckets * channels * 2);
+        std::vector<float> &level0 = levels[0];
+        std::vector<float> samples(base * channels);
+        for (size_t bucket = 0; bucket < buckets; bucket++)
+        {
+            size_t n = read(bucket * base, base, samples.data());
+            for (int channel = 0; channel < channels; channel++)
+            {
+                float low = n ? samples[channel] : 0.0f;
+                float high = low;
+                for (size_t i = 1; i < n; i++)
+                {
+                    float value = samples[i * channels + channel];
+                    low = value < low ? value : low;
+                    high = value > high ? value : high;
+                }
+                level0[(bucket * channels + channel) * 2] = low;
+                level0[(bucket * channels + channel) * 2 + 1] = high;
+            }
+        }
+        while (buckets > 1)
+        {
+            const std::vector<float> &previous = levels.back();
+            size_t merged = (buckets + 1) / 2;
+            std::vector<float> level(merged * channels * 2);
+            for (size_t bucket = 0; bucket < merged; bucket++)
+            {
+                size_t second = 2 * bucket + 1 < buckets ? 2 * bucket + 1 : 2 * bucket;
+                for (int channel = 0; channel < channels; channel++)
+                {
+                    const float *a = &previous[(2 * bucket * channels + channel) * 2];
+                    const float *b = &previous[(second * channels + channel) * 2];
+                    level[(bucket * channels + channel) * 2] = a[0] < b[0] ? a[0] : b[0];
+                    level[(bucket * channels + channel) * 2 + 1] = a[1] > b[1] ? a[1] : b[1];
+                }
+            }
+            levels.push_back(std::move(level));
+            buckets = merged;
+        }
+    }
+
+    size_t level_count() const { return levels.size(); }
+    size_t buckets(size_t level) const { return levels[level].size() / (channels * 2); }
+
+    // (min, max) pairs of level, bucket-major then channel
+    const std::vector<float> &level(size_t level) const { return levels[level]; }
+
+    // Coarsest level that still has at least one bucket
+    // per pixel when frames_per_pixel frames are shown
+    size_t level_for(size_t frames_per_pixel) const
+    {
+        size_t level = 0;
+        while (level + 1 < levels.size() && (base << (level + 1)) <= frames_per_pixel)
+            level++;
+        return level;
+    }
+
+    void save(const char *path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+            throw std::runtime_error(std::string("Can't open file: ") + path);
+        OverviewHeader header{{'W', 'O', 'V', 'R'}, 1, (uint32_t)sample_rate, (uint32_t)channels,
+                              frames, (uint32_t)base, (uint32_t)levels.size()};
+        file.write((const char *)&header, sizeof(header));
+        uint64_t offset = sizeof(header) + sizeof(OverviewLevel) * levels.size();
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            OverviewLevel entry{offset, buckets(i)};
+            file.write((const char *)&entry, sizeof(entry));
+            offset += sizeof(float) * levels[i].size();
+        }
+        for (const std::vector<float> &level : levels)
+        {
+            file.write((const char *)level.data(), sizeof(float) * level.size());
+        }
         file.close();
+        if (!file)
+            throw std::runtime_error(std::string("Write failed: ") + path);
+    }
+
+    // Read one level from saved file without reading the others
+    static std::vector<float> load_level(const char *path, size_t level, OverviewHeader &header)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+            throw std::runtime_error(std::string("Can't open file: ") + path);
+        uint64_t file_size = (uint64_t)file.tellg();
+        file.seekg(0);
+        file.read((char *)&header, sizeof(header));
+        if (!file || memcmp(header.magic, "WOVR", 4) != 0 || header.version != 1)
+            throw std::runtime_error(std::string("Not a waveform overview file: ") + path);
+        if (level >= header.levels)
+            throw std::runtime_error("Overview level out of range");
+        OverviewLevel entry;
+        file.seekg(sizeof(header) + sizeof(OverviewLevel) * level);
+        file.read((char *)&entry, sizeof(entry));
+        if (!file)
+            throw std::runtime_error(std::string("Truncated waveform overview file: ") + path);
+        // level data must lie inside the file, checked without overflow
+        uint64_t pair_bytes = sizeof(float) * 2 * (uint64_t)header.channels;
+        if (entry.offset > file_size || header.channels == 0 ||
+            entry.buckets > (file_size - entry.offset) / pair_bytes)
+            throw std::runtime_error(std::string("Overview level outside of file: ") + path);
+        std::vector<float> data(entry.buckets * header.channels * 2);
+        file.seekg(entry.offset);
+        file.read((char *)data.data(), sizeof(float) * data.size());
+        if (!file)
+            throw std::runtime_error(std::string("Truncated waveform overview file: ") + path);
+        return data;
     }
 };
 
+// Convert WAV file of any supported format to another sample
+// rate and bit depth. File is read through the mapping and fed
+// to the resampler in chunks, output is streamed to disk, so
+// memory usage does not depend on file length
+void convert_wav(const char *input_path, const char *output_path, int output_rate, int output_bits,
+                 bool dither = true)
+{
+    WavReader reader(input_path);
+    reader.advise_sequential();
+    int channels = reader.get_channels();
+    const size_t chunk = 16384;
+    Resampler resampler(reader.get_sample_rate(), output_rate, channels);
+    std::vector<float> input(chunk * channels);
+    size_t stride = resampler.max_output(chunk) + Resampler::taps;
+    std::vector<float> output(stride * channels);
+
+    WavFile file(output_path, output_rate, channels, output_bits);
+    file.set_dither(dither);
+    file.open_stream();
+    // first latency() frames are filter delay, output is
+    // cut to the length of the input
+    size_t skip = resampler.latency();
+    size_t left = resampler.output_frames(reader.frame_count());
+    auto append = [&](size_t produced) {
+        size_t dropped = produced < skip ? produced : skip;
+        skip -= dropped;
+        size_t n = produced - dropped < left ? produced - dropped : left;
+        file.append_planar(output.data() + dropped, stride, n);
+        left -= n;
+    };
+    for (size_t first = 0; first < reader.frame_count(); first += chunk)
+    {
+        size_t frames = reader.read_float(first, chunk, input.data());
+        append(resampler.process(input.data(), frames, output.data(), stride));
+    }
+    append(resampler.flush(output.data(), stride));
+    file.close_stream();
+}
+
+// Compare polyphase resampler with linear interpolation
+// on 10 seconds of 96 kHz stereo converted to 44.1 kHz
+void benchmark_resampler()
+{
+    const int input_rate = 96000;
+    const int output_rate = 44100;
+    const size_t frames = input_rate * 10;
+    std::vector<float> input(frames * 2);
+    Oscillator oscillator(Waveform::Sine, 1000.0f, 0.5f, input_rate);
+    std::vector<float> mono(frames);
+    oscillator.fill(mono.data(), frames);
+    for (size_t i = 0; i < frames; i++)
+        input[i * 2] = input[i * 2 + 1] = mono[i];
+
+    std::vector<float> linear;
+    auto start = std::chrono::steady_clock::now();
+    resample_linear(input.data(), frames, 2, input_rate, output_rate, linear);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Linear resampler: " << frames / elapsed.count() / 1e6 << " M input frames/s\n";
+
+    const size_t chunk = 4096;
+    Resampler resampler(input_rate, output_rate, 2);
+    size_t stride = resampler.max_output(chunk);
+    std::vector<float> output(stride * 2);
+    size_t produced = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t first = 0; first < frames; first += chunk)
+    {
+        size_t n = frames - first < chunk ? frames - first : chunk;
+        produced += resampler.process(input.data() + first * 2, n, output.data(), stride);
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Polyphase resampler (" << Resampler::taps << " taps): " << frames / elapsed.count() / 1e6
+              << " M input frames/s, " << produced << " frames out\n";
+}
+
+// Check FFT against direct DFT, find the tone of test.wav
+// in its spectrogram and measure speed of the transform
+void test_spectrum()
+{
+    const size_t size = 256;
+    std::vector<float> input(size);
+    for (size_t i = 0; i < size; i++)
+        input[i] = (float)(sin(i * 0.37) + 0.25 * cos(i * 1.3));
+    RealFFT fft(size);
+    FftWorkspace work;
+    std::vector<float> out_re(fft.bins()), out_im(fft.bins());
+    fft.transform(input.data(), out_re.data(), out_im.data(), work);
+    double max_error = 0;
+    for (size_t k = 0; k < fft.bins(); k++)
+    {
+        double re = 0, im = 0;
+        for (size_t n = 0; n < size; n++)
+        {
+            re += input[n] * cos(-2 * M_PI * k * n / size);
+            im += input[n] * sin(-2 * M_PI * k * n / size);
+        }
+        max_error = fmax(max_error, fmax(fabs(re - out_re[k]), fabs(im - out_im[k])));
+    }
+    std::cout << "FFT max error against DFT: " << max_error << "\n";
+
+    ThreadPool pool;
+    STFT stft(4096, 1024);
+    WavReader reader("test.wav");
+    size_t peak = 0;
+    float peak_power = -1e30f;
+    size_t bins = 4096 / 2 + 1;
+    stft.analyze(reader, 0, pool, [&](size_t, size_t count, const float *rows) {
+        for (size_t i = 0; i < count * bins; i++)
+        {
+            if (rows[i] > peak_power)
+            {
+                peak_power = rows[i];
+                peak = i % bins;
+            }
+        }
+    });
+    std::cout << "Peak of test.wav: " << peak * 44100.0 / 4096 << " Hz, " << peak_power << " dB\n";
+
+    WavFile file("noise.wav", 44100, 1, 16);
+    file.generate_wave(Waveform::Saw, 1000, 0.5, 60);
+    auto start = std::chrono::steady_clock::now();
+    Spectrogram spectrogram = stft.analyze(file.channel(0), 44100, pool);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "STFT (4096 points): " << spectrogram.frames / elapsed.count() << " frames/s\n";
+}
+
+// Export mix in all formats and read back
+// one level of its overview pyramid
+void test_export()
+{
+    WavReader reader("mix.wav");
+    FrameReader read = frame_reader(reader);
+    auto start = std::chrono::steady_clock::now();
+    export_csv("mix.csv", read, reader.get_channels(), reader.frame_count());
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "CSV export: " << reader.frame_count() / elapsed.count() / 1e6 << " M frames/s\n";
+    export_raw("mix.raw", read, reader.get_channels(), reader.frame_count());
+
+    WaveformOverview overview(read, reader.get_channels(), reader.get_sample_rate(), reader.frame_count());
+    overview.save("mix.wovr");
+    // 1000 pixels wide view of the whole file
+    size_t level = overview.level_for(reader.frame_count() / 1000);
+    OverviewHeader header;
+    std::vector<float> pairs = WaveformOverview::load_level("mix.wovr", level, header);
+    std::cout << "Overview: " << overview.level_count() << " levels, level " << level << " has "
+              << pairs.size() / (header.channels * 2) << " buckets, first min/max: " << pairs[0] << " "
+              << pairs[1] << "\n";
+}
+
+// Render the same mix of tracks with different number of
+// threads, check that result does not change and print speed
+void test_render_graph()
+{
+    const int sample_rate = 44100;
+    const size_t frames = sample_rate * 20;
+    RenderGraph graph;
+    std::vector<const RenderNode *> tracks;
+    for (int i = 0; i < 24; i++)
+    {
+        const RenderNode &tone = graph.oscillator((Waveform)(i % 4), 110.0f * (i + 1), 0.5f, sample_rate);
+        tracks.push_back(&graph.pan(graph.gain(tone, 1.0f / 24), -1.0f + i / 12.0f));
+    }
+    // file written by main() is mixed in the middle
+    WavReader reader("test.wav");
+    tracks.push_back(&graph.gain(graph.file(reader), 0.5f));
+    const RenderNode &output = graph.mix(tracks, 2);
+
+    std::vector<float> reference;
+    size_t max_threads = std::thread::hardware_concurrency();
+    max_threads = max_threads > 1 ? max_threads : 2;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        ThreadPool pool(threads);
+        WavFile file("mix.wav", sample_rate, 2, 16);
+        auto start = std::chrono::steady_clock::now();
+        graph.render(output, frames, file, pool);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::vector<float> result(frames * 2);
+        for (int channel = 0; channel < 2; channel++)
+        {
+            ChannelView view = file.channel(channel);
+            for (size_t i = 0; i < frames; i++)
+                result[i * 2 + channel] = view[i];
+        }
+        if (reference.empty())
+            reference = result;
+        bool identical = memcmp(reference.data(), result.data(), sizeof(float) * result.size()) == 0;
+        std::cout << "Render graph (" << threads << " threads): " << frames / elapsed.count() / 1e6
+                  << " M frames/s, identical to 1 thread: " << (identical ? "yes" : "no") << "\n";
+        if (threads == 1)
+            file.save();
+    }
+}
+
 int main()
 {
     const char *filename = "test.wav";
@@ -117,5 +3240,51 @@ int main()
     file.show_range(0, 10);
     // Save file
     file.save();
+
+    // Saved file can be read back without loading
+    // it: samples are viewed right in the mapped file
+    WavReader reader(filename);
+    FrameView<int16_t> samples = reader.samples_int16();
+    std::cout << "Read " << reader.frame_count() << " frames at " << reader.get_sample_rate()
+              << " Hz, first sample of second frame: " << samples.at(1, 0) << std::endl;
+    reader.show_range(0, 10);
+
+    // Long clips can be streamed to disk block by block,
+    // so memory usage stays the same for any duration
+    WavFile long_file("long.wav", 44100, 1, 16);
+    long_file.open_stream();
+    long_file.generate_sin(440, 0.5, 60);
+    long_file.close_stream();
+
+    // Same with background I/O thread: generator does not
+    // wait for disk, flush() tells when data is written
+    WavFile async_file("long_async.wav", 44100, 2, 16);
+    async_file.open_async_stream();
+    async_file.generate_sin(440, 0.5, 30);
+    std::future<void> written = async_file.flush();
+    async_file.generate_wave(Waveform::Triangle, 220, 0.5, 30);
+    written.wait();
+    async_file.close_stream();
+
+    // Stereo file: right channel is made quieter
+    // through its planar view before saving
+    WavFile stereo_file("stereo.wav", 44100, 2, 16);
+    stereo_file.generate_sin(330, 0.5, 1);
+    ChannelView right = stereo_file.channel(1);
+    for (size_t i = 0; i < right.size(); i++)
+    {
+        right[i] *= 0.25f;
+    }
+    stereo_file.show_range(0, 4);
+    stereo_file.save();
+
+    test_render_graph();
+    // 44.1 kHz mix is converted to 48 kHz 24-bit
+    convert_wav("mix.wav", "mix_48k.wav", 48000, 24);
+    benchmark_resampler();
+    test_spectrum();
+    test_export();
+    check_oscillator_accuracy();
+    benchmark_oscillators();
     return 0;
 }
\ No newline at end of file
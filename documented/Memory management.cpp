@@ -3,60 +3,345 @@
 #include <memory.h> // memory management functions
 #include <iostream> // input/output stream classes
 
+// atomic - operations that other threads see whole, never half-done
+// memory order - how much ordering an atomic operation guarantees:
+// relaxed only makes the operation itself atomic, acquire/release also
+// make the writes before a release visible after the matching acquire
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory> // std::shared_ptr for comparison
+#include <memory_resource> // std::pmr::memory_resource
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <malloc.h> // mallinfo2
+#endif
+
+// Counter policies - the reference counts are changed only through them,
+// so WeakPtr can use atomics or plain integers (template parameter)
+
+// counter for pointers shared between threads
+class AtomicCounter
+{
+private:
+    std::atomic<unsigned int> m_value;
+
+public:
+    AtomicCounter(unsigned int value) : m_value(value) {}
+
+    // a new reference is made from an existing one, so nothing has to be
+    // ordered against it - relaxed is enough
+    void increment()
+    {
+        m_value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // returns true when the count reached zero
+    // release: our writes to the object happen before the delete
+    // acquire: the thread that deletes sees writes of all other owners
+    bool decrement()
+    {
+        return m_value.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    // increments only if the count is not zero yet (used by WeakRef::lock)
+    bool increment_if_not_zero()
+    {
+        unsigned int value = m_value.load(std::memory_order_relaxed);
+        while (value != 0)
+        {
+            if (m_value.compare_exchange_weak(value, value + 1, std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    unsigned int get() const
+    {
+        return m_value.load(std::memory_order_relaxed);
+    }
+};
+
+// counter for single-threaded hot paths, no atomic instructions
+class PlainCounter
+{
+private:
+    unsigned int m_value;
+
+public:
+    PlainCounter(unsigned int value) : m_value(value) {}
+
+    void increment()
+    {
+        m_value++;
+    }
+
+    bool decrement()
+    {
+        return --m_value == 0;
+    }
+
+    bool increment_if_not_zero()
+    {
+        if (m_value == 0)
+            return false;
+        m_value++;
+        return true;
+    }
+
+    unsigned int get() const
+    {
+        return m_value;
+    }
+};
+
+// Control block - shared by all WeakPtr and WeakRef of one object
+// strong - number of WeakPtr, the object lives while it is not zero
+// weak - number of WeakRef, plus one for all WeakPtr together,
+//        the block itself lives while it is not zero
+template <typename Counter>
+class ControlBlock
+{
+public:
+    Counter strong;
+    Counter weak;
+
+    ControlBlock() : strong(1), weak(1) {}
+
+    // virtual destructor - the block is deleted through the base class
+    virtual ~ControlBlock() {}
+
+    // deletes the object, the block stays for WeakRef
+    virtual void dispose() = 0;
+
+    void release_strong()
+    {
+        if (strong.decrement())
+        {
+            dispose();
+            release_weak();
+        }
+    }
+
+    // frees the block itself, blocks from an allocator override it
+    virtual void destroy()
+    {
+        delete this;
+    }
+
+    void release_weak()
+    {
+        if (weak.decrement())
+            destroy();
+    }
+};
+
+// control block for an object allocated by the caller with new
+template <typename T, typename Counter>
+class PointerBlock : public ControlBlock<Counter>
+{
+private:
+    T* m_ptr;
+
+public:
+    PointerBlock(T* ptr) : m_ptr(ptr) {}
+
+    void dispose() override
+    {
+        delete m_ptr;
+    }
+};
+
+template <typename T, typename Counter = AtomicCounter>
+class WeakPtr;
+
+// control block with the object stored inside it (see make_weak),
+// one allocation for both
+template <typename T, typename Counter>
+class InlineBlock : public ControlBlock<Counter>
+{
+private:
+    // raw memory with the size and alignment of T, the object is
+    // constructed in it with placement new
+    alignas(T) unsigned char m_storage[sizeof(T)];
+
+public:
+    template <typename... Args>
+    InlineBlock(Args&&... args)
+    {
+        new (m_storage) T(std::forward<Args>(args)...);
+    }
+
+    T* get()
+    {
+        return reinterpret_cast<T*>(m_storage);
+    }
+
+    void dispose() override
+    {
+        get()->~T();
+    }
+};
+
+// control block with a deleter, deleter(ptr) is called instead of delete
+// (objects from an arena or malloc, handles that have to be closed...)
+template <typename T, typename Deleter, typename Counter>
+class DeleterBlock : public ControlBlock<Counter>
+{
+private:
+    T* m_ptr;
+    Deleter m_deleter;
+
+public:
+    DeleterBlock(T* ptr, Deleter deleter) : m_ptr(ptr), m_deleter(std::move(deleter)) {}
+
+    void dispose() override
+    {
+        m_deleter(m_ptr);
+    }
+};
+
+// control block and object in memory from an allocator (see allocate_weak)
+template <typename T, typename Allocator, typename Counter>
+class AllocatedBlock : public InlineBlock<T, Counter>
+{
+private:
+    // rebind - the same allocator for another type
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<AllocatedBlock> BlockAllocator;
+    BlockAllocator m_allocator;
+
+public:
+    template <typename... Args>
+    AllocatedBlock(const Allocator& allocator, Args&&... args)
+        : InlineBlock<T, Counter>(std::forward<Args>(args)...), m_allocator(allocator)
+    {
+    }
+
+    // the allocator is copied out first, the block is destroyed with it
+    void destroy() override
+    {
+        BlockAllocator allocator(m_allocator);
+        this->~AllocatedBlock();
+        std::allocator_traits<BlockAllocator>::deallocate(allocator, this, 1);
+    }
+};
+
+template <typename T, typename Counter>
+class WeakRef;
+
+template <typename T, typename Counter = AtomicCounter, typename... Args>
+WeakPtr<T, Counter> make_weak(Args&&... args);
+
+template <typename T, typename Counter = AtomicCounter, typename Allocator, typename... Args>
+WeakPtr<T, Counter> allocate_weak(const Allocator& allocator, Args&&... args);
+
 // template - a generic class or function
 // typename - a keyword used to declare a type
 // T - a template parameter
-template <typename T>
+// Counter - counter policy, AtomicCounter is safe to copy across threads
+// null pointers have no control block
+template <typename T, typename Counter>
 class WeakPtr
 {
 private:
     // pointer to the object
     T* m_ptr;
-    // pointer to the reference counter
-    unsigned int* m_refCount;
+    // pointer to the reference counts
+    ControlBlock<Counter>* m_control;
+
+    // WeakRef::lock, make_weak and allocate_weak create WeakPtr from
+    // a count that is already incremented
+    friend class WeakRef<T, Counter>;
+    template <typename U, typename C, typename... Args>
+    friend WeakPtr<U, C> make_weak(Args&&... args);
+    template <typename U, typename C, typename A, typename... Args>
+    friend WeakPtr<U, C> allocate_weak(const A& allocator, Args&&... args);
+    WeakPtr(ControlBlock<Counter>* control, T* ptr) : m_ptr(ptr), m_control(control) {}
+
+    void release()
+    {
+        if (m_control)
+            m_control->release_strong();
+    }
 
 public:
     // constructor
     WeakPtr(T* ptr = nullptr)
     {
         m_ptr = ptr;
-        m_refCount = new unsigned int(1);
+        m_control = ptr ? new PointerBlock<T, Counter>(ptr) : nullptr;
+    }
+
+    // constructor with a deleter, deleter(ptr) frees the object
+    template <typename Deleter>
+    WeakPtr(T* ptr, Deleter deleter)
+    {
+        m_ptr = ptr;
+        m_control = ptr ? new DeleterBlock<T, Deleter, Counter>(ptr, std::move(deleter)) : nullptr;
     }
 
     // copy constructor
-    WeakPtr(const WeakPtr<T>& other)
+    WeakPtr(const WeakPtr<T, Counter>& other)
+    {
+        m_ptr = other.m_ptr;
+        m_control = other.m_control;
+        if (m_control)
+            m_control->strong.increment();
+    }
+
+    // move constructor - takes over the reference of other,
+    // the count does not change
+    WeakPtr(WeakPtr<T, Counter>&& other) noexcept
     {
         m_ptr = other.m_ptr;
-        m_refCount = other.m_refCount;
-        (*m_refCount)++;
+        m_control = other.m_control;
+        other.m_ptr = nullptr;
+        other.m_control = nullptr;
     }
 
     // destructor
     ~WeakPtr()
     {
-        (*m_refCount)--;
-        if (*m_refCount == 0)
-        {
-            delete m_ptr;
-            delete m_refCount;
-        }
+        release();
     }
 
     // assignment operator
-    WeakPtr<T>& operator=(const WeakPtr<T>& other)
+    // the new count is taken before the old one is released, so assigning
+    // a pointer to itself (or to a copy of itself) is safe
+    // other is read before release(), because releasing may delete the
+    // object that holds other (p = p->next in a linked list)
+    WeakPtr<T, Counter>& operator=(const WeakPtr<T, Counter>& other)
     {
-        if (this != &other)
-        {
-            (*m_refCount)--;
-            if (*m_refCount == 0)
-            {
-                delete m_ptr;
-                delete m_refCount;
-            }
-            m_ptr = other.m_ptr;
-            m_refCount = other.m_refCount;
-            (*m_refCount)++;
-        }
+        T* ptr = other.m_ptr;
+        ControlBlock<Counter>* control = other.m_control;
+        if (control)
+            control->strong.increment();
+        release();
+        m_ptr = ptr;
+        m_control = control;
+        return *this;
+    }
+
+    // move assignment operator
+    WeakPtr<T, Counter>& operator=(WeakPtr<T, Counter>&& other) noexcept
+    {
+        T* ptr = other.m_ptr;
+        ControlBlock<Counter>* control = other.m_control;
+        other.m_ptr = nullptr;
+        other.m_control = nullptr;
+        release();
+        m_ptr = ptr;
+        m_control = control;
         return *this;
     }
 
@@ -77,21 +362,1359 @@ public:
     {
         return m_ptr != nullptr;
     }
+
+    // number of WeakPtr sharing the object
+    // (only a hint when other threads copy the pointer at the same time)
+    unsigned int use_count() const
+    {
+        return m_control ? m_control->strong.get() : 0;
+    }
 };
 
+// make_weak - creates the object and its counts in one allocation,
+// like std::make_shared
+// Args&&... - the constructor arguments, forwarded unchanged to T
+template <typename T, typename Counter, typename... Args>
+WeakPtr<T, Counter> make_weak(Args&&... args)
+{
+    InlineBlock<T, Counter>* block = new InlineBlock<T, Counter>(std::forward<Args>(args)...);
+    return WeakPtr<T, Counter>(block, block->get());
+}
 
-void test_weak() {
-    WeakPtr<int> p1(new int(5));
-    WeakPtr<int> p2(p1);
-    WeakPtr<int> p3;
-    p3 = p1;
-    std::cout << *p1 << std::endl;
-    std::cout << *p2 << std::endl;
-    std::cout << *p3 << std::endl;
+// allocate_weak - make_weak with memory from an allocator,
+// like std::allocate_shared
+template <typename T, typename Counter, typename Allocator, typename... Args>
+WeakPtr<T, Counter> allocate_weak(const Allocator& allocator, Args&&... args)
+{
+    typedef AllocatedBlock<T, Allocator, Counter> Block;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Block> BlockAllocator;
+    BlockAllocator block_allocator(allocator);
+    Block* block = std::allocator_traits<BlockAllocator>::allocate(block_allocator, 1);
+    try
+    {
+        new (block) Block(allocator, std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+        std::allocator_traits<BlockAllocator>::deallocate(block_allocator, block, 1);
+        throw;
+    }
+    return WeakPtr<T, Counter>(block, block->get());
 }
 
-int main()
+// Weak reference - observes an object owned by WeakPtr without keeping it
+// alive, lock() returns a WeakPtr if the object still exists
+template <typename T, typename Counter = AtomicCounter>
+class WeakRef
 {
-    test_weak();
-    return 0;
-};
\ No newline at end of file
+private:
+    T* m_ptr;
+    ControlBlock<Counter>* m_control;
+
+public:
+    WeakRef(const WeakPtr<T, Counter>& owner)
+    {
+        m_ptr = owner.m_ptr;
+        m_control = owner.m_control;
+        if (m_control)
+            m_control->weak.increment();
+    }
+
+    WeakRef(const WeakRef<T, Counter>& other)
+    {
+        m_ptr = other.m_ptr;
+        m_control = other.m_control;
+        if (m_control)
+            m_control->weak.increment();
+    }
+
+    ~WeakRef()
+    {
+        if (m_control)
+            m_control->release_weak();
+    }
+
+    WeakRef<T, Counter>& operator=(const WeakRef<T, Counter>& other)
+    {
+        if (other.m_control)
+            other.m_control->weak.increment();
+        if (m_control)
+            m_control->release_weak();
+        m_ptr = other.m_ptr;
+        m_control = other.m_control;
+        return *this;
+    }
+
+    // true when all WeakPtr are gone and the object was deleted
+    bool expired() const
+    {
+        return !m_control || m_control->strong.get() == 0;
+    }
+
+    // the count is incremented only if it is not zero yet, so the object
+    // can't be deleted between the check and the new WeakPtr
+    WeakPtr<T, Counter> lock() const
+    {
+        if (m_control && m_control->strong.increment_if_not_zero())
+            return WeakPtr<T, Counter>(m_control, m_ptr);
+        return WeakPtr<T, Counter>();
+    }
+};
+
+// Intrusive reference counting - the count is a member of the object
+// itself, so the pointer is only one pointer wide and there is no
+// control block to load on every access
+// CRTP (curiously recurring template pattern) - Derived inherits from
+// RefCounted<Derived>, so the base knows the real type to delete
+template <typename Derived, typename Counter = AtomicCounter>
+class RefCounted
+{
+private:
+    // mutable - can be changed on const objects too
+    mutable Counter m_refCount;
+
+protected:
+    RefCounted() : m_refCount(0) {}
+    // a copy of an object is a new object, its count starts again
+    RefCounted(const RefCounted&) : m_refCount(0) {}
+    RefCounted& operator=(const RefCounted&) { return *this; }
+    ~RefCounted() {}
+
+public:
+    // hooks used by IntrusivePtr, found by argument dependent lookup (ADL),
+    // so other classes can provide their own add_ref/release_ref instead
+    friend void add_ref(const Derived* ptr)
+    {
+        static_cast<const RefCounted*>(ptr)->m_refCount.increment();
+    }
+
+    friend void release_ref(const Derived* ptr)
+    {
+        if (static_cast<const RefCounted*>(ptr)->m_refCount.decrement())
+            delete ptr;
+    }
+
+    unsigned int use_count() const
+    {
+        return m_refCount.get();
+    }
+};
+
+// pointer to an object with its own count (add_ref/release_ref),
+// with the same interface as WeakPtr
+template <typename T>
+class IntrusivePtr
+{
+private:
+    T* m_ptr;
+
+public:
+    IntrusivePtr(T* ptr = nullptr)
+    {
+        m_ptr = ptr;
+        if (m_ptr)
+            add_ref(m_ptr);
+    }
+
+    IntrusivePtr(const IntrusivePtr<T>& other)
+    {
+        m_ptr = other.m_ptr;
+        if (m_ptr)
+            add_ref(m_ptr);
+    }
+
+    IntrusivePtr(IntrusivePtr<T>&& other) noexcept
+    {
+        m_ptr = other.m_ptr;
+        other.m_ptr = nullptr;
+    }
+
+    ~IntrusivePtr()
+    {
+        if (m_ptr)
+            release_ref(m_ptr);
+    }
+
+    // the same order as in WeakPtr: take the new reference, then release
+    IntrusivePtr<T>& operator=(const IntrusivePtr<T>& other)
+    {
+        T* ptr = other.m_ptr;
+        if (ptr)
+            add_ref(ptr);
+        if (m_ptr)
+            release_ref(m_ptr);
+        m_ptr = ptr;
+        return *this;
+    }
+
+    IntrusivePtr<T>& operator=(IntrusivePtr<T>&& other) noexcept
+    {
+        T* ptr = other.m_ptr;
+        other.m_ptr = nullptr;
+        if (m_ptr)
+            release_ref(m_ptr);
+        m_ptr = ptr;
+        return *this;
+    }
+
+    T& operator*()
+    {
+        return *m_ptr;
+    }
+
+    T* operator->()
+    {
+        return m_ptr;
+    }
+
+    operator bool()
+    {
+        return m_ptr != nullptr;
+    }
+};
+
+// Memory resources - where objects get their memory from
+// std::pmr::memory_resource - the standard interface, containers in
+// std::pmr (std::pmr::vector...) take a pointer to one
+
+// Monotonic arena - takes memory from big chunks by moving a pointer,
+// deallocate does nothing and release() frees everything at once
+// fast when many objects die together (a frame, a request, a game tree)
+class MonotonicArena : public std::pmr::memory_resource
+{
+private:
+    struct Chunk
+    {
+        Chunk* next;
+        size_t size;
+    };
+
+    Chunk* m_chunks = nullptr;
+    char* m_current = nullptr;
+    char* m_end = nullptr;
+    size_t m_chunk_size;
+    size_t m_next_size;
+    size_t m_used = 0;
+    size_t m_reserved = 0;
+
+public:
+    explicit MonotonicArena(size_t chunk_size = 64 * 1024) : m_chunk_size(chunk_size), m_next_size(chunk_size) {}
+
+    // the arena owns its memory, copies would free it twice
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    ~MonotonicArena()
+    {
+        release();
+    }
+
+    void release()
+    {
+        while (m_chunks)
+        {
+            Chunk* next = m_chunks->next;
+            ::operator delete(m_chunks);
+            m_chunks = next;
+        }
+        m_current = m_end = nullptr;
+        m_next_size = m_chunk_size;
+        m_used = m_reserved = 0;
+    }
+
+    // bytes given out and bytes taken from the system
+    size_t used() const
+    {
+        return m_used;
+    }
+
+    size_t reserved() const
+    {
+        return m_reserved;
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        // round the current position up to the alignment
+        uintptr_t p = ((uintptr_t)m_current + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        if (!m_current || p + bytes > (uintptr_t)m_end)
+        {
+            // a new chunk, each one twice as big as the last (up to 64 MiB)
+            size_t size = std::max(m_next_size, sizeof(Chunk) + bytes + alignment);
+            Chunk* chunk = (Chunk*)::operator new(size);
+            chunk->next = m_chunks;
+            chunk->size = size;
+            m_chunks = chunk;
+            m_current = (char*)(chunk + 1);
+            m_end = (char*)chunk + size;
+            m_reserved += size;
+            m_next_size = std::min(size * 2, (size_t)64 << 20);
+            p = ((uintptr_t)m_current + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        }
+        m_current = (char*)(p + bytes);
+        m_used += bytes;
+        return (void*)p;
+    }
+
+    void do_deallocate(void*, size_t, size_t) override
+    {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+// Size-class pool - blocks of 16, 32, 64 ... 1024 bytes, larger ones
+// come from operator new
+// every thread has its own free lists, so allocate and deallocate need no
+// lock; a block freed by another thread goes back to the thread that cut it
+// (through an atomic list), else a producer/consumer pair of threads would
+// take new chunks forever while the freed blocks pile up in the consumer
+class PoolResource : public std::pmr::memory_resource
+{
+public:
+    static const size_t min_block = 16;
+    static const int classes = 7;
+    static const size_t max_block = min_block << (classes - 1);
+    static const size_t chunk_size = 64 * 1024;
+
+    // the thread lists are shared by the whole program, so is the pool
+    static PoolResource* instance()
+    {
+        static PoolResource pool;
+        return &pool;
+    }
+
+    // bytes taken from operator new, all threads together
+    size_t reserved() const
+    {
+        return chunks().reserved.load(std::memory_order_relaxed);
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        if (bytes > max_block || alignment > min_block)
+        {
+            void* ptr = ::operator new(bytes, std::align_val_t(alignment));
+            chunks().reserved.fetch_add(bytes, std::memory_order_relaxed);
+            return ptr;
+        }
+        int size_class = class_of(bytes);
+        ThreadCache& own = cache();
+        FreeBlock*& head = own.free[size_class];
+        // blocks freed by other threads first, then a new chunk
+        if (!head)
+            head = own.remote[size_class].exchange(nullptr, std::memory_order_acquire);
+        if (!head)
+            head = refill(size_class, &own);
+        FreeBlock* block = head;
+        head = block->next;
+        return block;
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+    {
+        if (bytes > max_block || alignment > min_block)
+        {
+            ::operator delete(ptr, std::align_val_t(alignment));
+            chunks().reserved.fetch_sub(bytes, std::memory_order_relaxed);
+            return;
+        }
+        int size_class = class_of(bytes);
+        FreeBlock* block = (FreeBlock*)ptr;
+        // chunks are aligned to their size, the header gives the owner
+        ChunkHeader* chunk = (ChunkHeader*)((uintptr_t)ptr & ~(uintptr_t)(chunk_size - 1));
+        ThreadCache& own = cache();
+        if (chunk->owner == &own)
+        {
+            block->next = own.free[size_class];
+            own.free[size_class] = block;
+            return;
+        }
+        // many threads can push, only the owner takes the whole list
+        std::atomic<FreeBlock*>& remote = chunk->owner->remote[size_class];
+        FreeBlock* head = remote.load(std::memory_order_relaxed);
+        do
+            block->next = head;
+        while (!remote.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return dynamic_cast<const PoolResource*>(&other) != nullptr;
+    }
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct ThreadCache
+    {
+        FreeBlock* free[classes];
+        std::atomic<FreeBlock*> remote[classes];    // freed by other threads
+    };
+
+    // at the start of every chunk, blocks follow it
+    struct ChunkHeader
+    {
+        ThreadCache* owner;
+    };
+    static const size_t header_size = (sizeof(ChunkHeader) + min_block - 1) / min_block * min_block;
+
+    // blocks can move between threads, so chunks are not freed when a
+    // thread ends but when the program does; the cache of an ended thread
+    // (with its chunks) is taken over by the next new thread
+    struct Chunks
+    {
+        std::mutex mutex;
+        std::vector<void*> list;
+        std::vector<ThreadCache*> caches;
+        std::vector<ThreadCache*> idle;
+        std::atomic<size_t> reserved{0};
+
+        ~Chunks()
+        {
+            for (void* chunk : list)
+                ::operator delete(chunk, std::align_val_t(chunk_size));
+            for (ThreadCache* cache : caches)
+                delete cache;
+        }
+    };
+
+    // gives the cache back when its thread ends
+    struct CacheOwner
+    {
+        ThreadCache* cache;
+
+        CacheOwner()
+        {
+            std::lock_guard<std::mutex> lock(chunks().mutex);
+            if (chunks().idle.empty())
+            {
+                cache = new ThreadCache();
+                chunks().caches.push_back(cache);
+            }
+            else
+            {
+                cache = chunks().idle.back();
+                chunks().idle.pop_back();
+            }
+        }
+
+        ~CacheOwner()
+        {
+            std::lock_guard<std::mutex> lock(chunks().mutex);
+            chunks().idle.push_back(cache);
+        }
+    };
+
+    PoolResource() {}
+
+    // thread_local - every thread has its own copy
+    static ThreadCache& cache()
+    {
+        static thread_local CacheOwner owner;
+        return *owner.cache;
+    }
+
+    static Chunks& chunks()
+    {
+        static Chunks chunks;
+        return chunks;
+    }
+
+    static int class_of(size_t bytes)
+    {
+        int size_class = 0;
+        while ((min_block << size_class) < bytes)
+            size_class++;
+        return size_class;
+    }
+
+    // cuts a new chunk into blocks of one class
+    static FreeBlock* refill(int size_class, ThreadCache* owner)
+    {
+        size_t size = min_block << size_class;
+        char* chunk = (char*)::operator new(chunk_size, std::align_val_t(chunk_size));
+        ((ChunkHeader*)chunk)->owner = owner;
+        {
+            std::lock_guard<std::mutex> lock(chunks().mutex);
+            chunks().list.push_back(chunk);
+        }
+        chunks().reserved.fetch_add(chunk_size, std::memory_order_relaxed);
+        FreeBlock* head = nullptr;
+        for (size_t offset = chunk_size; offset >= header_size + size; offset -= size)
+        {
+            FreeBlock* block = (FreeBlock*)(chunk + offset - size);
+            block->next = head;
+            head = block;
+        }
+        return head;
+    }
+};
+
+// Allocators - for standard containers (std::vector<int, PoolAllocator<int>>)
+// and allocate_weak; the Allocator requirements are value_type, allocate,
+// deallocate, a converting constructor (used for rebind) and ==
+template <typename T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+
+    PoolAllocator() {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        if (n > SIZE_MAX / sizeof(T))
+            throw std::bad_array_new_length();
+        return (T*)PoolResource::instance()->allocate(n * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T* ptr, size_t n)
+    {
+        PoolResource::instance()->deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+};
+
+// all pool allocators use the same pool
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&)
+{
+    return false;
+}
+
+template <typename T>
+class ArenaAllocator
+{
+private:
+    MonotonicArena* m_arena;
+
+    template <typename U>
+    friend class ArenaAllocator;
+
+public:
+    typedef T value_type;
+
+    ArenaAllocator(MonotonicArena* arena) : m_arena(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena) {}
+
+    T* allocate(size_t n)
+    {
+        if (n > SIZE_MAX / sizeof(T))
+            throw std::bad_array_new_length();
+        return (T*)m_arena->allocate(n * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T*, size_t)
+    {
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const
+    {
+        return m_arena == other.m_arena;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const
+    {
+        return m_arena != other.m_arena;
+    }
+};
+
+// Epoch-based reclamation - for objects read by many threads and changed
+// rarely (configuration, routing tables...)
+// readers don't touch any count: they only announce the global epoch they
+// started in; a replaced object is retired, not deleted, and a background
+// thread deletes retired objects in batches once every reader that might
+// still see them has left (the global epoch moved two steps further)
+class EpochDomain
+{
+private:
+    // one record per thread, epoch 0 means the thread is not reading
+    struct Record
+    {
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<bool> in_use{true};
+        Record* next = nullptr;
+        int depth = 0; // nested guards, only the owner thread uses it
+    };
+
+    struct Retired
+    {
+        void* ptr;
+        void (*deleter)(void*);
+        uint64_t epoch;
+        uint64_t sequence; // retire order, starts at 1
+    };
+
+    std::atomic<uint64_t> m_epoch{1};
+    std::atomic<Record*> m_records{nullptr};
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;     // a batch was deleted
+    std::deque<Retired> m_retired;      // in retire order
+    uint64_t m_sequence = 0;            // last sequence given out
+    uint64_t m_deleted = 0;             // all sequences up to it are deleted
+    bool m_reclaiming = false;          // a batch is being deleted
+    std::thread m_reclaimer;
+    bool m_stop = false;
+
+    EpochDomain() {}
+
+    // a record is taken over from an ended thread or added to the list,
+    // records are never freed, so readers can walk the list without locks
+    Record* acquire_record()
+    {
+        for (Record* record = m_records.load(std::memory_order_acquire); record; record = record->next)
+        {
+            bool free = false;
+            if (!record->in_use.load(std::memory_order_relaxed) &&
+                record->in_use.compare_exchange_strong(free, true, std::memory_order_acquire))
+                return record;
+        }
+        Record* record = new Record();
+        record->next = m_records.load(std::memory_order_relaxed);
+        while (!m_records.compare_exchange_weak(record->next, record, std::memory_order_release))
+        {
+        }
+        return record;
+    }
+
+    // the record of the calling thread, given back when the thread ends
+    Record* record()
+    {
+        struct Owner
+        {
+            Record* record = nullptr;
+            ~Owner()
+            {
+                if (record)
+                    record->in_use.store(false, std::memory_order_release);
+            }
+        };
+        static thread_local Owner owner;
+        if (!owner.record)
+            owner.record = acquire_record();
+        return owner.record;
+    }
+
+    // the epoch moves on only when all readers are in the current epoch
+    bool try_advance()
+    {
+        uint64_t epoch = m_epoch.load(std::memory_order_seq_cst);
+        for (Record* record = m_records.load(std::memory_order_acquire); record; record = record->next)
+        {
+            uint64_t reader = record->epoch.load(std::memory_order_seq_cst);
+            if (reader != 0 && reader != epoch)
+                return false;
+        }
+        return m_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+    }
+
+    // deletes everything retired two or more epochs ago, outside the lock
+    // epochs only grow, so these objects are always the oldest ones; with
+    // one batch at a time, everything up to m_deleted is really deleted
+    void reclaim(std::unique_lock<std::mutex>& lock)
+    {
+        m_reclaiming = true;
+        try_advance();
+        uint64_t epoch = m_epoch.load(std::memory_order_seq_cst);
+        size_t count = 0;
+        while (count < m_retired.size() && m_retired[count].epoch + 2 <= epoch)
+            count++;
+        std::vector<Retired> batch(m_retired.begin(), m_retired.begin() + count);
+        m_retired.erase(m_retired.begin(), m_retired.begin() + count);
+        lock.unlock();
+        for (Retired& r : batch)
+            r.deleter(r.ptr);
+        lock.lock();
+        if (!batch.empty())
+            m_deleted = batch.back().sequence;
+        m_reclaiming = false;
+        m_done.notify_all();
+    }
+
+    // sleeps while nothing is retired; while objects wait for the epoch
+    // to move on, it checks again every millisecond
+    void run_reclaimer()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop)
+        {
+            if (m_retired.empty())
+                m_wake.wait(lock, [this] { return m_stop || !m_retired.empty(); });
+            else
+                m_wake.wait_for(lock, std::chrono::milliseconds(1));
+            if (!m_stop && !m_reclaiming)
+                reclaim(lock);
+        }
+    }
+
+public:
+    static EpochDomain& instance()
+    {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    // at the end of the program no reader is left, everything is deleted
+    ~EpochDomain()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        if (m_reclaimer.joinable())
+            m_reclaimer.join();
+        // a deleted object may own an EpochPtr and retire more objects,
+        // so the list is taken out before deleting, until it stays empty
+        for (;;)
+        {
+            std::deque<Retired> batch;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                batch.swap(m_retired);
+            }
+            if (batch.empty())
+                break;
+            for (Retired& r : batch)
+                r.deleter(r.ptr);
+        }
+    }
+
+    // reader side, used by EpochGuard
+    // the announced epoch is checked again, because the global epoch may
+    // have moved on between reading it and announcing it
+    void enter()
+    {
+        Record* self = record();
+        if (self->depth++ > 0)
+            return;
+        uint64_t epoch = m_epoch.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            self->epoch.store(epoch, std::memory_order_seq_cst);
+            uint64_t current = m_epoch.load(std::memory_order_seq_cst);
+            if (current == epoch)
+                break;
+            epoch = current;
+        }
+    }
+
+    void leave()
+    {
+        Record* self = record();
+        if (--self->depth == 0)
+            self->epoch.store(0, std::memory_order_release);
+    }
+
+    bool reading()
+    {
+        return record()->depth > 0;
+    }
+
+    // writer side - ptr is deleted by the reclaimer thread later
+    template <typename T>
+    void retire(T* ptr)
+    {
+        if (!ptr)
+            return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_retired.push_back({ptr, [](void* p) { delete static_cast<T*>(p); }, m_epoch.load(std::memory_order_seq_cst),
+                             ++m_sequence});
+        // after the domain stopped, the destructor deletes what is left
+        if (!m_reclaimer.joinable() && !m_stop)
+            m_reclaimer = std::thread(&EpochDomain::run_reclaimer, this);
+        // the first object wakes the sleeping reclaimer, big batches are
+        // deleted without waiting for the next round
+        if (m_retired.size() == 1 || m_retired.size() >= 1024)
+            m_wake.notify_one();
+    }
+
+    // waits until everything retired before the call is deleted, objects
+    // retired later by other threads don't keep it waiting
+    // (must not be called while reading)
+    void synchronize()
+    {
+        assert(!reading());
+        std::unique_lock<std::mutex> lock(m_mutex);
+        uint64_t target = m_sequence;
+        while (m_deleted < target)
+        {
+            // the reclaimer thread is deleting a batch, wait for it
+            if (m_reclaiming)
+            {
+                m_done.wait(lock);
+                continue;
+            }
+            reclaim(lock);
+            if (m_deleted < target)
+            {
+                lock.unlock();
+                std::this_thread::yield();
+                lock.lock();
+            }
+        }
+    }
+};
+
+// reader critical section - objects seen inside it are not deleted before
+// it ends; guards can be nested
+class EpochGuard
+{
+public:
+    EpochGuard()
+    {
+        EpochDomain::instance().enter();
+    }
+
+    ~EpochGuard()
+    {
+        EpochDomain::instance().leave();
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+// Read-mostly shared pointer - reading is a plain atomic load, writers
+// replace the object and the old one is retired to EpochDomain
+// operator* and operator-> may only be used inside an EpochGuard
+template <typename T>
+class EpochPtr
+{
+private:
+    std::atomic<T*> m_ptr;
+
+public:
+    EpochPtr(T* ptr = nullptr) : m_ptr(ptr) {}
+
+    // one owner, copies would retire the object twice
+    EpochPtr(const EpochPtr<T>&) = delete;
+    EpochPtr<T>& operator=(const EpochPtr<T>&) = delete;
+
+    ~EpochPtr()
+    {
+        EpochDomain::instance().retire(m_ptr.load(std::memory_order_relaxed));
+    }
+
+    // replaces the object, readers still using the old one can finish
+    void reset(T* ptr = nullptr)
+    {
+        EpochDomain::instance().retire(m_ptr.exchange(ptr, std::memory_order_seq_cst));
+    }
+
+    T* load() const
+    {
+        return m_ptr.load(std::memory_order_acquire);
+    }
+
+    T& operator*() const
+    {
+        assert(EpochDomain::instance().reading());
+        return *load();
+    }
+
+    T* operator->() const
+    {
+        assert(EpochDomain::instance().reading());
+        return load();
+    }
+
+    operator bool() const
+    {
+        return load() != nullptr;
+    }
+};
+
+
+void test_weak() {
+    WeakPtr<int> p1(new int(5));
+    WeakPtr<int> p2(p1);
+    WeakPtr<int> p3;
+    p3 = p1;
+    std::cout << *p1 << std::endl;
+    std::cout << *p2 << std::endl;
+    std::cout << *p3 << std::endl;
+}
+
+// weak references see the object only while a WeakPtr owns it
+void test_weak_ref() {
+    WeakPtr<int> owner(new int(7));
+    WeakRef<int> ref(owner);
+    {
+        WeakPtr<int> locked = ref.lock();
+        std::cout << "locked: " << *locked << ", owners: " << owner.use_count() << std::endl;
+    }
+    owner = WeakPtr<int>();
+    std::cout << "expired: " << ref.expired() << ", lock: " << (bool)ref.lock() << std::endl;
+
+    // the same with the single-threaded counter
+    WeakPtr<int, PlainCounter> plain(new int(8));
+    WeakRef<int, PlainCounter> plain_ref(plain);
+    std::cout << "plain: " << *plain_ref.lock() << std::endl;
+}
+
+// make_weak and moves
+void test_make_weak() {
+    struct Point
+    {
+        double x, y;
+        Point(double x, double y) : x(x), y(y) {}
+    };
+    WeakPtr<Point> p1 = make_weak<Point>(1.0, 2.0);
+    WeakPtr<Point> p2(std::move(p1));
+    std::cout << "moved: " << (bool)p1 << " " << p2->x << " " << p2->y
+              << ", owners: " << p2.use_count() << std::endl;
+    WeakRef<Point> ref(p2);
+    p1 = std::move(p2);
+    std::cout << "owners after move: " << p1.use_count() << ", expired: " << ref.expired() << std::endl;
+    p1 = WeakPtr<Point>();
+    std::cout << "expired: " << ref.expired() << std::endl;
+}
+
+// intrusive pointer: the count is inside the object
+void test_intrusive() {
+    struct Counted : RefCounted<Counted>
+    {
+        int value;
+        Counted(int value) : value(value) {}
+    };
+    static_assert(sizeof(IntrusivePtr<Counted>) == sizeof(Counted*), "IntrusivePtr is one pointer wide");
+    IntrusivePtr<Counted> p1(new Counted(9));
+    IntrusivePtr<Counted> p2(p1);
+    IntrusivePtr<Counted> p3;
+    p3 = p2;
+    std::cout << "intrusive: " << p3->value << ", owners: " << p1->use_count() << std::endl;
+}
+
+// deleters, allocate_weak and containers with the allocators
+void test_allocators() {
+    int deleted = 0;
+    {
+        WeakPtr<int> p(new int(3), [&deleted](int* ptr) { delete ptr; deleted++; });
+        WeakPtr<int> copy(p);
+    }
+    std::cout << "deleter calls: " << deleted << std::endl;
+
+    MonotonicArena arena;
+    {
+        WeakPtr<std::string> text = allocate_weak<std::string>(ArenaAllocator<std::string>(&arena), "in arena");
+        WeakPtr<int> number = allocate_weak<int>(PoolAllocator<int>(), 42);
+        std::cout << *text << ", in pool " << *number << std::endl;
+    }
+    std::vector<int, PoolAllocator<int>> pooled = {1, 2, 3};
+    std::pmr::vector<int> in_arena(&arena);
+    in_arena.assign(1000, 7);
+    std::cout << "pool vector: " << pooled.size() << ", arena used " << arena.used()
+              << " of " << arena.reserved() << " bytes" << std::endl;
+}
+
+// readers and a writer of an EpochPtr
+void test_epoch() {
+    struct Config
+    {
+        int version;
+        Config(int version) : version(version) {}
+    };
+    EpochPtr<Config> config(new Config(1));
+    {
+        EpochGuard guard;
+        Config& old = *config;
+        config.reset(new Config(2));
+        // the old object is still valid here, the guard keeps it alive
+        std::cout << "epoch: old " << old.version << ", new " << config->version << std::endl;
+    }
+    EpochDomain::instance().synchronize();
+}
+
+// Contention benchmark - every thread copies and destroys the same pointer,
+// so all threads change one counter and its cache line moves between cores
+template <typename Pointer>
+double copy_ns(const Pointer& shared, int threads, int copies)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&shared, copies] {
+            for (int i = 0; i < copies; i++)
+            {
+                Pointer copy(shared);
+                // keeps the compiler from removing the copy
+#if defined(__GNUC__)
+                asm volatile("" : : "r"(&copy) : "memory");
+#endif
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    auto time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    return time.count() / ((double)threads * copies);
+}
+
+void benchmark_weak(int max_threads) {
+    const int copies = 1000000;
+    WeakPtr<int> weak(new int(1));
+    std::shared_ptr<int> shared(new int(1));
+    std::cout << "threads  WeakPtr ns/copy  std::shared_ptr ns/copy" << std::endl;
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        std::cout << threads << "\t " << copy_ns(weak, threads, copies)
+                  << "\t\t  " << copy_ns(shared, threads, copies) << std::endl;
+    }
+
+    // PlainCounter may only be used by one thread
+    WeakPtr<int, PlainCounter> plain(new int(1));
+    std::cout << "single thread, PlainCounter ns/copy: " << copy_ns(plain, 1, copies) << std::endl;
+
+    // creating and destroying: two allocations with new, one with make_weak
+    auto create_ns = [&](auto create) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < copies; i++)
+        {
+            auto pointer = create(i);
+#if defined(__GNUC__)
+            asm volatile("" : : "r"(&pointer) : "memory");
+#endif
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / copies;
+    };
+    std::cout << "create ns: WeakPtr(new) " << create_ns([](int i) { return WeakPtr<int>(new int(i)); })
+              << ", make_weak " << create_ns([](int i) { return make_weak<int>(i); })
+              << ", std::make_shared " << create_ns([](int i) { return std::make_shared<int>(i); }) << std::endl;
+}
+
+// Traversal benchmark - a linked list walked with a pointer copy per node,
+// as in code that follows shared links (cur = cur->next)
+// builds the list, walks it and frees it node by node (the destructor
+// chain of a million nodes would overflow the stack)
+template <typename Pointer, typename Create>
+double traverse_ns(int nodes, Create create)
+{
+    Pointer head;
+    for (int i = 0; i < nodes; i++)
+    {
+        Pointer node = create();
+        node->value = i;
+        node->next = std::move(head);
+        head = std::move(node);
+    }
+
+    long long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (Pointer cur = head; cur; cur = cur->next)
+        sum += cur->value;
+    auto time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+
+    while (head)
+        head = std::move(head->next);
+    if (sum != (long long)nodes * (nodes - 1) / 2)
+        std::cout << "wrong sum " << sum << std::endl;
+    return time.count() / nodes;
+}
+
+void benchmark_traversal(int nodes) {
+    struct WeakNode
+    {
+        long long value;
+        WeakPtr<WeakNode> next;
+    };
+    struct SharedNode
+    {
+        long long value;
+        std::shared_ptr<SharedNode> next;
+    };
+    struct IntrusiveNode : RefCounted<IntrusiveNode>
+    {
+        long long value;
+        IntrusivePtr<IntrusiveNode> next;
+    };
+    std::cout << "traversal of " << nodes << " nodes, ns/node:" << std::endl;
+    std::cout << "WeakPtr (new)        " << traverse_ns<WeakPtr<WeakNode>>(nodes, [] { return WeakPtr<WeakNode>(new WeakNode()); }) << std::endl;
+    std::cout << "WeakPtr (make_weak)  " << traverse_ns<WeakPtr<WeakNode>>(nodes, [] { return make_weak<WeakNode>(); }) << std::endl;
+    std::cout << "std::shared_ptr      " << traverse_ns<std::shared_ptr<SharedNode>>(nodes, [] { return std::make_shared<SharedNode>(); }) << std::endl;
+    std::cout << "IntrusivePtr         " << traverse_ns<IntrusivePtr<IntrusiveNode>>(nodes, [] { return IntrusivePtr<IntrusiveNode>(new IntrusiveNode()); }) << std::endl;
+}
+
+// Allocator benchmark - the allocation patterns of the demos:
+// control blocks - make_weak<int>, small blocks freed in random order
+// objects - DerivedExample from its operator+ (make_unique), an object
+//           with a std::ifstream inside, about 0.5 KiB
+// vectors - std::vector<int> growing by push_back as in the STL demo
+
+// malloc and free as a memory resource, so all are called the same way
+class MallocResource : public std::pmr::memory_resource
+{
+protected:
+    void* do_allocate(size_t bytes, size_t) override
+    {
+        void* ptr = malloc(bytes);
+        if (!ptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+
+    void do_deallocate(void* ptr, size_t, size_t) override
+    {
+        free(ptr);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+// bytes malloc holds for blocks in use (with its headers), 0 if unknown
+size_t malloc_reserved() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+struct AllocResult
+{
+    double ns;          // per allocation (with its free)
+    size_t live;        // bytes in use at the peak
+    size_t reserved;    // bytes taken from the system for them
+};
+
+// keeps live blocks, replaces a random one per step
+AllocResult churn(std::pmr::memory_resource* resource, const std::function<size_t()>& reserved,
+                  size_t size, size_t live, size_t steps) {
+    std::vector<void*> blocks(live, nullptr);
+    std::mt19937 random(1);
+    size_t before = reserved();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; i++)
+    {
+        void*& block = blocks[random() % live];
+        if (block)
+            resource->deallocate(block, size);
+        block = resource->allocate(size);
+        *(char*)block = (char)i;
+    }
+    auto time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    AllocResult result = {time.count() / steps, 0, reserved() - before};
+    for (void* block : blocks)
+    {
+        if (block)
+        {
+            result.live += size;
+            resource->deallocate(block, size);
+        }
+    }
+    return result;
+}
+
+// one thread allocates, the calling one frees - at most live blocks
+// are on the way between them
+AllocResult handoff(std::pmr::memory_resource* resource, const std::function<size_t()>& reserved,
+                    size_t size, size_t live, size_t steps) {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<void*> queue;
+    size_t before = reserved();
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&] {
+        for (size_t i = 0; i < steps; i++)
+        {
+            void* block = resource->allocate(size);
+            *(char*)block = (char)i;
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return queue.size() < live; });
+            queue.push_back(block);
+            changed.notify_all();
+        }
+    });
+    for (size_t i = 0; i < steps; i++)
+    {
+        void* block;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return !queue.empty(); });
+            block = queue.front();
+            queue.pop_front();
+            changed.notify_all();
+        }
+        resource->deallocate(block, size);
+    }
+    producer.join();
+    auto time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    return {time.count() / steps, live * size, reserved() - before};
+}
+
+// builds vectors by push_back, one at a time
+AllocResult grow(std::pmr::memory_resource* resource, const std::function<size_t()>& reserved,
+                 size_t elements, size_t vectors) {
+    AllocResult result = {0, 0, 0};
+    size_t before = reserved();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t v = 0; v < vectors; v++)
+    {
+        std::pmr::vector<int> numbers(resource);
+        for (size_t i = 0; i < elements; i++)
+            numbers.push_back((int)i);
+        result.live = numbers.capacity() * sizeof(int);
+        result.reserved = std::max(result.reserved, reserved() - before);
+        // an arena is released with the data it was used for
+        if (MonotonicArena* arena = dynamic_cast<MonotonicArena*>(resource))
+            arena->release();
+    }
+    auto time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    result.ns = time.count() / (elements * vectors);
+    return result;
+}
+
+void benchmark_allocators() {
+    MallocResource malloc_resource;
+    MonotonicArena arena;
+    PoolResource* pool = PoolResource::instance();
+    struct Resource
+    {
+        const char* name;
+        std::pmr::memory_resource* resource;
+        std::function<size_t()> reserved;
+    };
+    Resource resources[] = {
+        {"malloc", &malloc_resource, malloc_reserved},
+        {"MonotonicArena", &arena, [&arena] { return arena.reserved(); }},
+        {"PoolResource", pool, [pool] { return pool->reserved(); }},
+    };
+
+    auto print = [](const char* pattern, const char* name, AllocResult result) {
+        std::cout << pattern << "\t" << name << "\t" << result.ns << " ns, " << result.live / 1024
+                  << " KiB live, " << result.reserved / 1024 << " KiB reserved" << std::endl;
+    };
+    const size_t block_size = sizeof(InlineBlock<int, AtomicCounter>);
+    const size_t object_size = sizeof(std::ifstream) + sizeof(void*);
+    std::cout << "pattern\t\tresource\ttime per allocation, memory at the end" << std::endl;
+    // the arena never reuses freed blocks, its memory grows with every step
+    for (Resource& r : resources)
+    {
+        print("control blocks", r.name, churn(r.resource, r.reserved, block_size, 100000, 2000000));
+        arena.release();
+    }
+    for (Resource& r : resources)
+    {
+        print("objects\t", r.name, churn(r.resource, r.reserved, object_size, 10000, 500000));
+        arena.release();
+    }
+    for (Resource& r : resources)
+    {
+        print("handoff\t", r.name, handoff(r.resource, r.reserved, block_size, 100, 2000000));
+        arena.release();
+    }
+    for (Resource& r : resources)
+        print("vectors\t", r.name, grow(r.resource, r.reserved, 100000, 100));
+}
+
+// Stress test - readers check objects while writers replace them, a
+// deleted object would show its poisoned marker (or trip AddressSanitizer)
+void stress_epoch(int threads, int milliseconds) {
+    struct Object
+    {
+        uint64_t marker;
+        uint64_t value;
+        uint64_t check;
+        std::atomic<long>* alive;
+
+        Object(uint64_t value, std::atomic<long>* alive) : marker(0x600DF00D), value(value), check(~value), alive(alive)
+        {
+            alive->fetch_add(1, std::memory_order_relaxed);
+        }
+
+        ~Object()
+        {
+            // volatile - the write must not be removed as a dead store
+            *(volatile uint64_t*)&marker = 0xDEADBEEF;
+            alive->fetch_sub(1, std::memory_order_relaxed);
+        }
+    };
+
+    std::atomic<long> alive(0);
+    EpochPtr<Object> shared(new Object(0, &alive));
+    std::atomic<bool> stop(false);
+    std::atomic<long> reads(0), replaces(0), errors(0);
+    std::vector<std::thread> workers;
+    int writers = std::max(1, threads / 4);
+    for (int t = 0; t < threads; t++)
+    {
+        bool writer = t < writers;
+        workers.emplace_back([&, writer, t] {
+            long count = 0;
+            for (uint64_t i = 0; !stop.load(std::memory_order_relaxed); i++)
+            {
+                if (writer)
+                {
+                    shared.reset(new Object(i * threads + t, &alive));
+                    count++;
+                    continue;
+                }
+                EpochGuard guard;
+                Object* object = shared.load();
+                if (object->marker != 0x600DF00D || object->check != ~object->value)
+                    errors.fetch_add(1, std::memory_order_relaxed);
+                count++;
+            }
+            (writer ? replaces : reads).fetch_add(count, std::memory_order_relaxed);
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+    stop = true;
+    for (std::thread& worker : workers)
+        worker.join();
+    shared.reset();
+    EpochDomain::instance().synchronize();
+    std::cout << "epoch stress: " << threads << " threads, " << reads << " reads, " << replaces
+              << " replaces, " << errors << " errors, " << alive << " objects left" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    test_weak();
+    test_weak_ref();
+    test_make_weak();
+    test_intrusive();
+    test_allocators();
+    test_epoch();
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        int threads = argc > 2 ? atoi(argv[2]) : (int)std::thread::hardware_concurrency() * 2;
+        benchmark_weak(threads > 0 ? threads : 1);
+        benchmark_traversal(1000000);
+        benchmark_allocators();
+    }
+    if (argc > 1 && strcmp(argv[1], "stress") == 0)
+    {
+        int threads = argc > 2 ? atoi(argv[2]) : (int)std::thread::hardware_concurrency() * 2;
+        stress_epoch(threads > 1 ? threads : 2, argc > 3 ? atoi(argv[3]) : 1000);
+    }
+    return 0;
+};
@@ -1,10 +1,58 @@
 
 // includes for the STL algorithms
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <random>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
+// std::execution::par is used for threads == 0 when the standard library has it.
+// MSVC has it built in, with GCC it needs TBB: build with -DSTL_PARALLEL_EXECUTION -ltbb
+#if defined(_MSC_VER) && _MSC_VER >= 1914 && _HAS_CXX17
+#define STL_PARALLEL_EXECUTION
+#endif
+#ifdef STL_PARALLEL_EXECUTION
+#include <execution>
+#endif
+
+// SSE2 is part of every x86-64 CPU, AVX2 is used by the search trees when the compiler targets it
+// (-mavx2, /arch:AVX2)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEARCH_SIMD
+#include <immintrin.h>
+#endif
+
+// the SSE4.1 and AVX2 set kernels are compiled for their instruction set with target attributes
+// (MSVC needs none) and picked by the CPU at run time, so one binary runs on every x86-64 CPU
+#if defined(SEARCH_SIMD) && (defined(__GNUC__) || defined(_MSC_VER))
+#define SET_SIMD
+#endif
+#if defined(__GNUC__)
+#define SET_SSE41 __attribute__((target("sse4.1")))
+#define SET_AVX2 __attribute__((target("avx2")))
+#define SET_FLATTEN __attribute__((flatten))
+#else
+#define SET_SSE41
+#define SET_AVX2
+#define SET_FLATTEN
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 using namespace std;
 
 template <class T>
@@ -130,14 +178,1273 @@ void test_algorithms() {
     print_title("set_union");
     print(v1);
     print(v2);
-    vector<int> v4(10);
-    set_union(v1.begin(), v1.end(), v2.begin(), v2.end(), v4.begin());
+    // set_union returns the end of the written values: equal elements are written once,
+    // so the result can be shorter than v4 and has to be cut, otherwise zeros are left at the end
+    vector<int> v4(v1.size() + v2.size());
+    v4.resize(set_union(v1.begin(), v1.end(), v2.begin(), v2.end(), v4.begin()) - v4.begin());
     print(v4);
 
 
 }
 
-int main() {
+// Parallel versions of sort, nth_element and partial_sort for big vectors (millions of elements).
+// The range is split into one chunk per thread, every thread works on its own chunk
+// and the results of the chunks are combined at the end.
+// threads == 0 means "let the standard library decide" - std::execution::par when it is available,
+// otherwise one thread per core.
+
+int default_threads() {
+    return max(1, (int)thread::hardware_concurrency());
+}
+
+// runs body(0) ... body(threads - 1) at the same time, body(0) on the calling thread
+template <class Body>
+void run_parallel(int threads, Body body) {
+    vector<thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(body, t);
+    body(0);
+    for (auto& worker : workers)
+        worker.join();
+}
+
+// parallel_merge - merges two sorted ranges into out using several threads.
+// The first range is cut into equal parts, lower_bound finds the matching cut in the second range,
+// so every part can be merged on its own. Equal elements of the first range stay in front (stable).
+template <class It, class Out, class Compare>
+void parallel_merge(It first1, It last1, It first2, It last2, Out out, int threads, Compare comp) {
+    size_t n1 = last1 - first1;
+    if (threads <= 1 || n1 < 4096) {
+        merge(first1, last1, first2, last2, out, comp);
+        return;
+    }
+    vector<It> cuts1(threads + 1), cuts2(threads + 1);
+    for (int t = 0; t <= threads; t++) {
+        cuts1[t] = first1 + n1 * t / threads;
+        cuts2[t] = t == 0 ? first2 : (t == threads ? last2 : lower_bound(first2, last2, *cuts1[t], comp));
+    }
+    run_parallel(threads, [&](int t) {
+        Out part_out = out + ((cuts1[t] - first1) + (cuts2[t] - first2));
+        merge(cuts1[t], cuts1[t + 1], cuts2[t], cuts2[t + 1], part_out, comp);
+    });
+}
+
+// parallel_merge_sort - stable sort: every thread sorts its chunk with stable_sort,
+// then sorted chunks are merged in pairs until one is left; the data moves between
+// the range and a buffer, all threads help with every merge
+template <class It, class Compare = less<>>
+void parallel_merge_sort(It first, It last, int threads, Compare comp = Compare()) {
+    typedef typename iterator_traits<It>::value_type T;
+    size_t n = last - first;
+    if (threads == 0) {
+#ifdef STL_PARALLEL_EXECUTION
+        stable_sort(execution::par, first, last, comp);
+        return;
+#else
+        threads = default_threads();
+#endif
+    }
+    if (threads <= 1 || n < 4096) {
+        stable_sort(first, last, comp);
+        return;
+    }
+
+    vector<size_t> bounds;
+    for (int t = 0; t <= threads; t++)
+        bounds.push_back(n * t / threads);
+    run_parallel(threads, [&](int t) { stable_sort(first + bounds[t], first + bounds[t + 1], comp); });
+
+    vector<T> buffer(n);
+    bool in_buffer = false;
+    while (bounds.size() > 2) {
+        vector<size_t> merged;
+        for (size_t i = 0; i + 1 < bounds.size(); i += 2) {
+            merged.push_back(bounds[i]);
+            size_t middle = bounds[i + 1];
+            size_t end = i + 2 < bounds.size() ? bounds[i + 2] : middle;
+            if (in_buffer)
+                parallel_merge(buffer.begin() + bounds[i], buffer.begin() + middle, buffer.begin() + middle,
+                               buffer.begin() + end, first + bounds[i], threads, comp);
+            else
+                parallel_merge(first + bounds[i], first + middle, first + middle, first + end,
+                               buffer.begin() + bounds[i], threads, comp);
+        }
+        merged.push_back(n);
+        bounds = merged;
+        in_buffer = !in_buffer;
+    }
+    if (in_buffer)
+        run_parallel(threads, [&](int t) {
+            copy(buffer.begin() + n * t / threads, buffer.begin() + n * (t + 1) / threads, first + n * t / threads);
+        });
+}
+
+// parallel_radix_sort - LSD radix sort of integer keys, one byte per pass.
+// Every pass: each thread counts the bytes in its chunk, prefix sums give every (thread, byte) pair
+// its place in the output, then each thread moves its chunk there. The sort is stable.
+// Signed keys get their sign bit flipped so negative numbers come first.
+template <class T>
+void parallel_radix_sort(vector<T>& v, int threads) {
+    static_assert(is_integral<T>::value, "radix sort needs integer keys");
+    typedef typename make_unsigned<T>::type Key;
+    const Key sign = is_signed<T>::value ? Key(Key(1) << (sizeof(T) * 8 - 1)) : Key(0);
+    if (threads == 0)
+        threads = default_threads();
+    size_t n = v.size();
+    if (n < 2)
+        return;
+    if (n < 4096)
+        threads = 1;
+
+    vector<T> buffer(n);
+    vector<array<size_t, 256>> counts(threads);
+    for (int shift = 0; shift < (int)sizeof(T) * 8; shift += 8) {
+        auto digit = [&](T value) { return (size_t)((Key(value) ^ sign) >> shift & 0xFF); };
+        run_parallel(threads, [&](int t) {
+            counts[t].fill(0);
+            for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++)
+                counts[t][digit(v[i])]++;
+        });
+
+        // all keys have the same byte - nothing to move in this pass
+        size_t first_bucket = 0;
+        for (int t = 0; t < threads; t++)
+            first_bucket += counts[t][digit(v[0])];
+        if (first_bucket == n)
+            continue;
+
+        size_t offset = 0;
+        for (int d = 0; d < 256; d++)
+            for (int t = 0; t < threads; t++) {
+                size_t count = counts[t][d];
+                counts[t][d] = offset;
+                offset += count;
+            }
+        run_parallel(threads, [&](int t) {
+            array<size_t, 256>& positions = counts[t];
+            for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++)
+                buffer[positions[digit(v[i])]++] = v[i];
+        });
+        v.swap(buffer);
+    }
+}
+
+// parallel_nth_element - a sorted sample gives two values lo and hi around the wanted element.
+// In parallel every element goes into one of three groups: < lo, between lo and hi, > hi.
+// Usually the wanted element is in the middle group, which is small, so only it needs nth_element.
+// If the sample was unlucky, sequential nth_element is used.
+template <class It, class Compare = less<>>
+void parallel_nth_element(It first, It nth, It last, int threads, Compare comp = Compare()) {
+    typedef typename iterator_traits<It>::value_type T;
+    size_t n = last - first;
+    if (threads == 0) {
+#ifdef STL_PARALLEL_EXECUTION
+        nth_element(execution::par, first, nth, last, comp);
+        return;
+#else
+        threads = default_threads();
+#endif
+    }
+    if (threads <= 1 || n < 65536 || nth == last) {
+        nth_element(first, nth, last, comp);
+        return;
+    }
+
+    size_t rank = nth - first;
+    const size_t samples = 4096;
+    vector<T> sample;
+    mt19937_64 random(n);
+    for (size_t i = 0; i < samples; i++)
+        sample.push_back(first[random() % n]);
+    sort(sample.begin(), sample.end(), comp);
+    size_t position = rank * samples / n;
+    const size_t margin = 128;
+    T lo = sample[position > margin ? position - margin : 0];
+    T hi = sample[min(samples - 1, position + margin)];
+
+    // counts[t] = {smaller, middle, bigger} in chunk t
+    vector<array<size_t, 3>> counts(threads);
+    auto group = [&](const T& value) { return comp(value, lo) ? 0 : (comp(hi, value) ? 2 : 1); };
+    run_parallel(threads, [&](int t) {
+        counts[t] = {0, 0, 0};
+        for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++)
+            counts[t][group(first[i])]++;
+    });
+    size_t totals[3] = {0, 0, 0};
+    for (auto& count : counts)
+        for (int g = 0; g < 3; g++)
+            totals[g] += count[g];
+    if (rank < totals[0] || rank >= totals[0] + totals[1]) {
+        nth_element(first, nth, last, comp);
+        return;
+    }
+
+    size_t offset[3] = {0, totals[0], totals[0] + totals[1]};
+    for (auto& count : counts)
+        for (int g = 0; g < 3; g++) {
+            size_t c = count[g];
+            count[g] = offset[g];
+            offset[g] += c;
+        }
+    vector<T> buffer(n);
+    run_parallel(threads, [&](int t) {
+        for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++)
+            buffer[counts[t][group(first[i])]++] = first[i];
+    });
+    nth_element(buffer.begin() + totals[0], buffer.begin() + rank, buffer.begin() + totals[0] + totals[1], comp);
+    run_parallel(threads, [&](int t) {
+        copy(buffer.begin() + n * t / threads, buffer.begin() + n * (t + 1) / threads, first + n * t / threads);
+    });
+}
+
+// parallel_partial_sort - parallel_nth_element moves the smallest elements to the front,
+// then only the front is sorted with parallel_merge_sort
+template <class It, class Compare = less<>>
+void parallel_partial_sort(It first, It middle, It last, int threads, Compare comp = Compare()) {
+    if (threads == 0) {
+#ifdef STL_PARALLEL_EXECUTION
+        partial_sort(execution::par, first, middle, last, comp);
+        return;
+#else
+        threads = default_threads();
+#endif
+    }
+    if (middle == first)
+        return;
+    if (middle != last)
+        parallel_nth_element(first, middle, last, threads, comp);
+    parallel_merge_sort(first, middle, threads, comp);
+}
+
+// Static search indexes - the same questions as lower_bound, upper_bound, binary_search and equal_range,
+// but the sorted data is stored in an order that needs fewer cache misses. Results are positions
+// in the original sorted vector (size() means "end"), so they can be used like the STL iterators.
+// Positions are stored as uint32_t, so an index holds less than 4G keys.
+
+// memory aligned to a cache line (64 bytes), C++17 aligned new
+template <class T>
+class AlignedArray {
+public:
+    explicit AlignedArray(size_t size = 0)
+        : m_data(size ? static_cast<T*>(::operator new(size * sizeof(T), align_val_t(64))) : nullptr), m_size(size) {}
+    ~AlignedArray() { if (m_data) ::operator delete(m_data, align_val_t(64)); }
+    AlignedArray(const AlignedArray&) = delete;
+    AlignedArray& operator=(const AlignedArray&) = delete;
+
+    T& operator[](size_t i) { return m_data[i]; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    T* m_data;
+    size_t m_size;
+};
+
+inline void prefetch(const void* address) {
+#if defined(__GNUC__)
+    __builtin_prefetch(address);
+#elif defined(SEARCH_SIMD)
+    _mm_prefetch((const char*)address, _MM_HINT_T0);
+#endif
+}
+
+// EytzingerIndex - the sorted array stored as a binary tree in BFS order:
+// root at index 1, children of k at 2k and 2k+1. The first levels of the tree share a few
+// cache lines, and the 16 (for 4 byte keys) great-great-grandchildren of k are in one cache line
+// at index 16k, so it is prefetched 4 levels before it is needed.
+template <class T>
+class EytzingerIndex {
+public:
+    explicit EytzingerIndex(const vector<T>& sorted)
+        : m_size(sorted.size()), m_tree(sorted.size() + 1), m_ranks(sorted.size() + 1) {
+        size_t next = 0;
+        build(sorted, next, 1);
+    }
+
+    size_t size() const { return m_size; }
+
+    size_t lower_bound(const T& value) const { return m_ranks[search<false>(value)]; }
+    size_t upper_bound(const T& value) const { return m_ranks[search<true>(value)]; }
+    bool binary_search(const T& value) const {
+        size_t k = search<false>(value);
+        return k != 0 && !(value < m_tree[k]);
+    }
+    pair<size_t, size_t> equal_range(const T& value) const { return {lower_bound(value), upper_bound(value)}; }
+
+    // lower_bound of many values: a group of queries goes down the tree level by level together,
+    // so the cache misses of different queries overlap instead of waiting one after another
+    void lower_bound(const T* values, size_t count, size_t* results) const {
+        const size_t group = 16;
+        int levels = 0;
+        while ((size_t(1) << levels) <= m_size)
+            levels++;
+        for (size_t first = 0; first < count; first += group) {
+            size_t in_group = min(group, count - first);
+            size_t k[group];
+            for (size_t j = 0; j < in_group; j++)
+                k[j] = 1;
+            for (int level = 0; level < levels; level++)
+                for (size_t j = 0; j < in_group; j++) {
+                    if (k[j] <= m_size) {
+                        prefetch(m_tree.data() + min(k[j] * prefetch_stride, m_size));
+                        k[j] = 2 * k[j] + (m_tree[k[j]] < values[first + j]);
+                    }
+                }
+            for (size_t j = 0; j < in_group; j++)
+                results[first + j] = m_ranks[last_left_turn(k[j])];
+        }
+    }
+
+private:
+    static constexpr size_t prefetch_stride = 64 / sizeof(T) > 0 ? 64 / sizeof(T) : 1;
+
+    size_t m_size;
+    AlignedArray<T> m_tree;
+    AlignedArray<uint32_t> m_ranks;  // m_ranks[k] - position of m_tree[k] in the sorted vector, m_ranks[0] = size
+
+    // in-order walk of the tree takes the sorted values one by one
+    void build(const vector<T>& sorted, size_t& next, size_t k) {
+        if (k == 1)
+            m_ranks[0] = (uint32_t)m_size;
+        if (k > m_size)
+            return;
+        build(sorted, next, 2 * k);
+        m_tree[k] = sorted[next];
+        m_ranks[k] = (uint32_t)next++;
+        build(sorted, next, 2 * k + 1);
+    }
+
+    // the answer is the last node where the search went left: strip the trailing 1 bits (right turns)
+    // and the last 0 bit (the left turn) from k
+    static size_t last_left_turn(size_t k) {
+        while (k & 1)
+            k >>= 1;
+        return k >> 1;
+    }
+
+    // goes right while the node is less than value (or not greater, for upper_bound)
+    template <bool Upper>
+    size_t search(const T& value) const {
+        size_t k = 1;
+        while (k <= m_size) {
+            prefetch(m_tree.data() + min(k * prefetch_stride, m_size));
+            k = 2 * k + (Upper ? !(value < m_tree[k]) : m_tree[k] < value);
+        }
+        return last_left_turn(k);
+    }
+};
+
+// STreeIndex - static B-tree for int keys: every node is one cache line of 16 sorted keys
+// and has 17 children, node k has children k * 17 + 1 ... k * 17 + 17. The tree is about 4 times
+// lower than the binary one, and all 16 keys of a node are compared at once with SIMD instructions.
+class STreeIndex {
+public:
+    static const int node_keys = 16;
+
+    explicit STreeIndex(const vector<int>& sorted)
+        : m_size(sorted.size()), m_nodes((sorted.size() + node_keys - 1) / node_keys),
+          m_keys(m_nodes * node_keys), m_ranks(m_nodes * node_keys + 1) {
+        size_t next = 0;
+        build(sorted, next, 0);
+        m_ranks[m_nodes * node_keys] = (uint32_t)m_size;
+    }
+
+    size_t size() const { return m_size; }
+
+    size_t lower_bound(int value) const { return m_ranks[search(value)]; }
+    // for integers "not greater than value" is "less than value + 1"
+    size_t upper_bound(int value) const { return value == INT_MAX ? m_size : lower_bound(value + 1); }
+    bool binary_search(int value) const {
+        size_t slot = search(value);
+        return m_ranks[slot] != m_size && m_keys[slot] == value;
+    }
+    pair<size_t, size_t> equal_range(int value) const { return {lower_bound(value), upper_bound(value)}; }
+
+    // lower_bound of many values, queries of a group go down the tree together
+    void lower_bound(const int* values, size_t count, size_t* results) const {
+        const size_t group = 16;
+        const size_t end = m_nodes * node_keys;
+        for (size_t first = 0; first < count; first += group) {
+            size_t in_group = min(group, count - first);
+            size_t k[group], slot[group];
+            for (size_t j = 0; j < in_group; j++) {
+                k[j] = 0;
+                slot[j] = end;
+            }
+            bool active = true;
+            while (active) {
+                active = false;
+                for (size_t j = 0; j < in_group; j++) {
+                    if (k[j] >= m_nodes)
+                        continue;
+                    int i = count_less(&m_keys[k[j] * node_keys], values[first + j]);
+                    if (i < node_keys)
+                        slot[j] = k[j] * node_keys + i;
+                    k[j] = k[j] * (node_keys + 1) + i + 1;
+                    if (k[j] < m_nodes)
+                        prefetch(&m_keys[k[j] * node_keys]);
+                    active = true;
+                }
+            }
+            for (size_t j = 0; j < in_group; j++)
+                results[first + j] = m_ranks[slot[j]];
+        }
+    }
+
+private:
+    size_t m_size;
+    size_t m_nodes;
+    AlignedArray<int> m_keys;        // unused slots hold INT_MAX
+    AlignedArray<uint32_t> m_ranks;  // position in the sorted vector of every slot, size for unused ones
+
+    void build(const vector<int>& sorted, size_t& next, size_t k) {
+        if (k >= m_nodes)
+            return;
+        for (int i = 0; i < node_keys; i++) {
+            build(sorted, next, k * (node_keys + 1) + i + 1);
+            size_t slot = k * node_keys + i;
+            if (next < m_size) {
+                m_keys[slot] = sorted[next];
+                m_ranks[slot] = (uint32_t)next++;
+            } else {
+                m_keys[slot] = INT_MAX;
+                m_ranks[slot] = (uint32_t)m_size;
+            }
+        }
+        build(sorted, next, k * (node_keys + 1) + node_keys + 1);
+    }
+
+    // number of keys of the node less than value - the keys are sorted, so it is also
+    // the position of the first key not less than value
+    static int count_less(const int* keys, int value) {
+#if defined(__AVX2__)
+        __m256i v = _mm256_set1_epi32(value);
+        __m256i less0 = _mm256_cmpgt_epi32(v, _mm256_load_si256((const __m256i*)keys));
+        __m256i less1 = _mm256_cmpgt_epi32(v, _mm256_load_si256((const __m256i*)(keys + 8)));
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(less0)) |
+                        (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(less1)) << 8;
+        return popcount16(mask);
+#elif defined(SEARCH_SIMD)
+        __m128i v = _mm_set1_epi32(value);
+        unsigned mask = 0;
+        for (int i = 0; i < 4; i++) {
+            __m128i less = _mm_cmpgt_epi32(v, _mm_load_si128((const __m128i*)(keys + 4 * i)));
+            mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(less)) << (4 * i);
+        }
+        return popcount16(mask);
+#else
+        int count = 0;
+        for (int i = 0; i < node_keys; i++)
+            count += keys[i] < value;
+        return count;
+#endif
+    }
+
+    static int popcount16(unsigned mask) {
+#if defined(__GNUC__)
+        return __builtin_popcount(mask);
+#else
+        int count = 0;
+        for (; mask; mask &= mask - 1)
+            count++;
+        return count;
+#endif
+    }
+
+    // slot of the first key not less than value
+    size_t search(int value) const {
+        size_t slot = m_nodes * node_keys;
+        size_t k = 0;
+        while (k < m_nodes) {
+            int i = count_less(&m_keys[k * node_keys], value);
+            if (i < node_keys)
+                slot = k * node_keys + i;
+            k = k * (node_keys + 1) + i + 1;
+        }
+        return slot;
+    }
+};
+
+// Set operations on sorted arrays of unique uint32_t / uint64_t values (ID lists).
+// Each function writes to out and returns the exact number of values written,
+// out must have room for: intersection - min(na, nb), union - na + nb, difference - na.
+//
+// SIMD version (SSE4.1 or AVX2, whichever the CPU has): a block of values of a is compared with every value of a block of b
+// at once (the b block is rotated lane by lane), the matching lanes are packed together with a shuffle
+// from a table and stored. When one array is more than 32 times longer than the other,
+// the short one is walked and each value is searched in the long one with galloping
+// (steps 1, 2, 4, 8, ... then binary search), which skips long runs without comparing them.
+
+namespace set_simd {
+    // pshufb masks that move the lanes selected by mask to the front of a 16 byte register
+    template <size_t ElementBytes>
+    constexpr array<array<uint8_t, 16>, (1 << (16 / ElementBytes))> make_sse_compact() {
+        array<array<uint8_t, 16>, (1 << (16 / ElementBytes))> table{};
+        for (size_t mask = 0; mask < table.size(); mask++) {
+            size_t byte = 0;
+            for (size_t lane = 0; lane < 16 / ElementBytes; lane++)
+                if (mask >> lane & 1)
+                    for (size_t i = 0; i < ElementBytes; i++)
+                        table[mask][byte++] = (uint8_t)(lane * ElementBytes + i);
+            for (; byte < 16; byte++)
+                table[mask][byte] = 0x80;
+        }
+        return table;
+    }
+
+    // the same for 32 byte registers, as 32-bit lane indexes for _mm256_permutevar8x32_epi32
+    template <size_t ElementBytes>
+    constexpr array<array<uint32_t, 8>, (1 << (32 / ElementBytes))> make_avx_compact() {
+        array<array<uint32_t, 8>, (1 << (32 / ElementBytes))> table{};
+        const size_t parts = ElementBytes / 4;
+        for (size_t mask = 0; mask < table.size(); mask++) {
+            size_t index = 0;
+            for (size_t lane = 0; lane < 32 / ElementBytes; lane++)
+                if (mask >> lane & 1)
+                    for (size_t i = 0; i < parts; i++)
+                        table[mask][index++] = (uint32_t)(lane * parts + i);
+            for (; index < 8; index++)
+                table[mask][index] = 0;
+        }
+        return table;
+    }
+
+    inline int popcount(unsigned mask) {
+#if defined(__GNUC__)
+        return __builtin_popcount(mask);
+#else
+        int count = 0;
+        for (; mask; mask &= mask - 1)
+            count++;
+        return count;
+#endif
+    }
+
+    // best instruction set of the CPU, checked once
+    enum class Level { Scalar, SSE41, AVX2 };
+
+    inline Level cpu_level() {
+#if defined(SET_SIMD) && defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return Level::AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return Level::SSE41;
+#elif defined(SET_SIMD) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        bool sse41 = info[2] & (1 << 19);
+        bool os_avx = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        if (os_avx && (info[1] & (1 << 5)))
+            return Level::AVX2;
+        if (sse41)
+            return Level::SSE41;
+#endif
+        return Level::Scalar;
+    }
+
+    inline Level level() {
+        static const Level best = cpu_level();
+        return best;
+    }
+
+    // Avx2<T>, Sse41<T>: lanes, match (bit per lane of a block of a equal to some lane of a block of b),
+    // store_compact (stores the lanes of a selected by mask, a full register is written).
+    // They take pointers, not registers, so no vector value crosses into code compiled without the target
+    template <class T>
+    struct Avx2;
+    template <class T>
+    struct Sse41;
+
+#ifdef SET_SIMD
+    template <>
+    struct Avx2<uint32_t> {
+        static const size_t lanes = 8;
+        SET_AVX2 static unsigned match(const uint32_t* a, const uint32_t* b) {
+            __m256i va = _mm256_loadu_si256((const __m256i*)a);
+            __m256i vb = _mm256_loadu_si256((const __m256i*)b);
+            __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+            __m256i equal = _mm256_cmpeq_epi32(va, vb);
+            for (int i = 1; i < 8; i++) {
+                vb = _mm256_permutevar8x32_epi32(vb, rotate);
+                equal = _mm256_or_si256(equal, _mm256_cmpeq_epi32(va, vb));
+            }
+            return (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(equal));
+        }
+        SET_AVX2 static size_t store_compact(uint32_t* out, const uint32_t* a, unsigned mask) {
+            static constexpr auto table = make_avx_compact<4>();
+            __m256i order = _mm256_loadu_si256((const __m256i*)table[mask].data());
+            __m256i v = _mm256_loadu_si256((const __m256i*)a);
+            _mm256_storeu_si256((__m256i*)out, _mm256_permutevar8x32_epi32(v, order));
+            return popcount(mask);
+        }
+    };
+
+    template <>
+    struct Avx2<uint64_t> {
+        static const size_t lanes = 4;
+        SET_AVX2 static unsigned match(const uint64_t* a, const uint64_t* b) {
+            __m256i va = _mm256_loadu_si256((const __m256i*)a);
+            __m256i vb = _mm256_loadu_si256((const __m256i*)b);
+            __m256i equal = _mm256_cmpeq_epi64(va, vb);
+            equal = _mm256_or_si256(equal, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+            equal = _mm256_or_si256(equal, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+            equal = _mm256_or_si256(equal, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+            return (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(equal));
+        }
+        SET_AVX2 static size_t store_compact(uint64_t* out, const uint64_t* a, unsigned mask) {
+            static constexpr auto table = make_avx_compact<8>();
+            __m256i order = _mm256_loadu_si256((const __m256i*)table[mask].data());
+            __m256i v = _mm256_loadu_si256((const __m256i*)a);
+            _mm256_storeu_si256((__m256i*)out, _mm256_permutevar8x32_epi32(v, order));
+            return popcount(mask);
+        }
+    };
+
+    template <>
+    struct Sse41<uint32_t> {
+        static const size_t lanes = 4;
+        SET_SSE41 static unsigned match(const uint32_t* a, const uint32_t* b) {
+            __m128i va = _mm_loadu_si128((const __m128i*)a);
+            __m128i vb = _mm_loadu_si128((const __m128i*)b);
+            __m128i equal = _mm_cmpeq_epi32(va, vb);
+            equal = _mm_or_si128(equal, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+            equal = _mm_or_si128(equal, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+            equal = _mm_or_si128(equal, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+            return (unsigned)_mm_movemask_ps(_mm_castsi128_ps(equal));
+        }
+        SET_SSE41 static size_t store_compact(uint32_t* out, const uint32_t* a, unsigned mask) {
+            static constexpr auto table = make_sse_compact<4>();
+            __m128i v = _mm_loadu_si128((const __m128i*)a);
+            _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i*)table[mask].data())));
+            return popcount(mask);
+        }
+    };
+
+    template <>
+    struct Sse41<uint64_t> {
+        static const size_t lanes = 2;
+        SET_SSE41 static unsigned match(const uint64_t* a, const uint64_t* b) {
+            __m128i va = _mm_loadu_si128((const __m128i*)a);
+            __m128i vb = _mm_loadu_si128((const __m128i*)b);
+            __m128i equal = _mm_cmpeq_epi64(va, vb);
+            equal = _mm_or_si128(equal, _mm_cmpeq_epi64(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+            return (unsigned)_mm_movemask_pd(_mm_castsi128_pd(equal));
+        }
+        SET_SSE41 static size_t store_compact(uint64_t* out, const uint64_t* a, unsigned mask) {
+            static constexpr auto table = make_sse_compact<8>();
+            __m128i v = _mm_loadu_si128((const __m128i*)a);
+            _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i*)table[mask].data())));
+            return popcount(mask);
+        }
+    };
+#endif
+
+    template <class T, class = void>
+    struct HasKernel : false_type {};
+    template <class T>
+    struct HasKernel<T, decltype((void)Sse41<T>::lanes)> : true_type {};
+
+    // block loop of set_intersection_simd - moves i and j past the compared blocks,
+    // returns the number of values written (out has room for na)
+    template <class K, class T>
+    size_t intersect_blocks(const T* a, size_t na, const T* b, size_t nb, T* out, size_t& i, size_t& j) {
+        const size_t W = K::lanes;
+        T spare[W];
+        size_t count = 0;
+        while (i + W <= na && j + W <= nb) {
+            unsigned mask = K::match(a + i, b + j);
+            // a full store near the end of out goes to spare, only the real values are copied
+            if (count + W <= na) {
+                count += K::store_compact(out + count, a + i, mask);
+            } else {
+                size_t found = K::store_compact(spare, a + i, mask);
+                copy(spare, spare + found, out + count);
+                count += found;
+            }
+            T a_max = a[i + W - 1], b_max = b[j + W - 1];
+            if (a_max <= b_max)
+                i += W;
+            if (b_max <= a_max)
+                j += W;
+        }
+        return count;
+    }
+
+    // block loop of set_difference_simd, the same contract
+    template <class K, class T>
+    size_t difference_blocks(const T* a, size_t na, const T* b, size_t nb, T* out, size_t& i, size_t& j) {
+        const size_t W = K::lanes;
+        const unsigned all = (1u << W) - 1;
+        T spare[W];
+        size_t count = 0;
+        // found - lanes of the current block of a already seen in b
+        unsigned found = 0;
+        while (i + W <= na && j + W <= nb) {
+            found |= K::match(a + i, b + j);
+            T a_max = a[i + W - 1], b_max = b[j + W - 1];
+            if (a_max <= b_max) {
+                if (count + W <= na) {
+                    count += K::store_compact(out + count, a + i, ~found & all);
+                } else {
+                    size_t kept = K::store_compact(spare, a + i, ~found & all);
+                    copy(spare, spare + kept, out + count);
+                    count += kept;
+                }
+                found = 0;
+                i += W;
+                if (a_max == b_max)
+                    j += W;
+            } else {
+                j += W;
+            }
+        }
+        // the rest of a block that was compared with earlier blocks of b only
+        for (size_t lane = 0; found && lane < W && i < na; lane++, i++) {
+            if (found >> lane & 1)
+                continue;
+            while (j < nb && b[j] < a[i])
+                j++;
+            if (j == nb || b[j] != a[i])
+                out[count++] = a[i];
+        }
+        return count;
+    }
+
+#ifdef SET_SIMD
+    // the loops compiled for each instruction set, flatten inlines the kernels into them
+    template <class T>
+    SET_FLATTEN SET_AVX2 size_t intersect_avx2(const T* a, size_t na, const T* b, size_t nb, T* out, size_t& i, size_t& j) {
+        return intersect_blocks<Avx2<T>>(a, na, b, nb, out, i, j);
+    }
+
+    template <class T>
+    SET_FLATTEN SET_SSE41 size_t intersect_sse41(const T* a, size_t na, const T* b, size_t nb, T* out, size_t& i, size_t& j) {
+        return intersect_blocks<Sse41<T>>(a, na, b, nb, out, i, j);
+    }
+
+    template <class T>
+    SET_FLATTEN SET_AVX2 size_t difference_avx2(const T* a, size_t na, const T* b, size_t nb, T* out, size_t& i, size_t& j) {
+        return difference_blocks<Avx2<T>>(a, na, b, nb, out, i, j);
+    }
+
+    template <class T>
+    SET_FLATTEN SET_SSE41 size_t difference_sse41(const T* a, size_t na, const T* b, size_t nb, T* out, size_t& i, size_t& j) {
+        return difference_blocks<Sse41<T>>(a, na, b, nb, out, i, j);
+    }
+#endif
+
+    // first index >= first with data[index] >= value
+    template <class T>
+    size_t gallop(const T* data, size_t first, size_t size, T value) {
+        size_t high = first, step = 1;
+        while (high < size && data[high] < value) {
+            first = high + 1;
+            high += step;
+            step <<= 1;
+        }
+        return std::lower_bound(data + first, data + min(high, size), value) - data;
+    }
+
+    // merge of up to three sorted sources without repeating values, prev is the last value already written
+    template <class T>
+    size_t union_tail(const T* p, size_t np, const T* a, size_t na, const T* b, size_t nb, T* out, bool has_prev, T prev) {
+        size_t ip = 0, ia = 0, ib = 0, count = 0;
+        while (ip < np || ia < na || ib < nb) {
+            const T* source = nullptr;
+            size_t* index = nullptr;
+            if (ip < np) {
+                source = p + ip;
+                index = &ip;
+            }
+            if (ia < na && (!source || a[ia] < *source)) {
+                source = a + ia;
+                index = &ia;
+            }
+            if (ib < nb && (!source || b[ib] < *source)) {
+                source = b + ib;
+                index = &ib;
+            }
+            T value = *source;
+            ++*index;
+            if (!has_prev || value != prev) {
+                out[count++] = value;
+                prev = value;
+                has_prev = true;
+            }
+        }
+        return count;
+    }
+
+#ifdef SET_SIMD
+    // merge network of two sorted 4-lane vectors: the smallest 4 values go to low, the rest to high
+    SET_SSE41 inline void merge4(__m128i a, __m128i b, __m128i& low, __m128i& high) {
+        __m128i t = _mm_min_epu32(a, b);
+        high = _mm_max_epu32(a, b);
+        for (int i = 0; i < 3; i++) {
+            t = _mm_alignr_epi8(t, t, 4);
+            low = _mm_min_epu32(t, high);
+            high = _mm_max_epu32(t, high);
+            t = low;
+        }
+        low = _mm_alignr_epi8(low, low, 4);
+    }
+
+    // stores the lanes of v that differ from the lane before (the lane before lane 0 is lane 3 of last)
+    SET_SSE41 inline size_t store_unique(__m128i last, __m128i v, uint32_t* out) {
+        static constexpr auto table = make_sse_compact<4>();
+        __m128i before = _mm_alignr_epi8(v, last, 12);
+        unsigned keep = ~(unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(before, v))) & 0xF;
+        _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i*)table[keep].data())));
+        return popcount(keep);
+    }
+
+    // vector merge: the 4 smallest waiting values leave every step, the next block comes from
+    // the array with the smaller next value
+    SET_SSE41 inline size_t union_sse41(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+        __m128i low, high;
+        merge4(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b), low, high);
+        __m128i last = _mm_set1_epi32((int)(min(a[0], b[0]) - 1));
+        size_t count = store_unique(last, low, out);
+        last = low;
+        size_t i = 4, j = 4;
+        while (i + 4 <= na && j + 4 <= nb) {
+            __m128i next;
+            if (a[i] <= b[j]) {
+                next = _mm_loadu_si128((const __m128i*)(a + i));
+                i += 4;
+            } else {
+                next = _mm_loadu_si128((const __m128i*)(b + j));
+                j += 4;
+            }
+            merge4(next, high, low, high);
+            count += store_unique(last, low, out + count);
+            last = low;
+        }
+        alignas(16) uint32_t waiting[4];
+        _mm_store_si128((__m128i*)waiting, high);
+        uint32_t prev = (uint32_t)_mm_extract_epi32(last, 3);
+        return count + union_tail(waiting, 4, a + i, na - i, b + j, nb - j, out + count, true, prev);
+    }
+#endif
+}
+
+template <class T>
+size_t set_intersection_simd(const T* a, size_t na, const T* b, size_t nb, T* out) {
+    if (na > nb) {
+        swap(a, b);
+        swap(na, nb);
+    }
+    size_t i = 0, j = 0, count = 0;
+    if (na * 32 < nb) {
+        for (; i < na && j < nb; i++) {
+            j = set_simd::gallop(b, j, nb, a[i]);
+            if (j < nb && b[j] == a[i])
+                out[count++] = a[i];
+        }
+        return count;
+    }
+#ifdef SET_SIMD
+    if constexpr (set_simd::HasKernel<T>::value) {
+        if (set_simd::level() == set_simd::Level::AVX2)
+            count = set_simd::intersect_avx2(a, na, b, nb, out, i, j);
+        else if (set_simd::level() == set_simd::Level::SSE41)
+            count = set_simd::intersect_sse41(a, na, b, nb, out, i, j);
+    }
+#endif
+    while (i < na && j < nb) {
+        if (a[i] < b[j])
+            i++;
+        else if (b[j] < a[i])
+            j++;
+        else {
+            out[count++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    return count;
+}
+
+template <class T>
+size_t set_union_simd(const T* a, size_t na, const T* b, size_t nb, T* out) {
+    if (na > nb) {
+        swap(a, b);
+        swap(na, nb);
+    }
+    if (na * 32 < nb) {
+        size_t j = 0, count = 0;
+        for (size_t i = 0; i < na; i++) {
+            size_t next = set_simd::gallop(b, j, nb, a[i]);
+            copy(b + j, b + next, out + count);
+            count += next - j;
+            out[count++] = a[i];
+            j = next < nb && b[next] == a[i] ? next + 1 : next;
+        }
+        copy(b + j, b + nb, out + count);
+        return count + (nb - j);
+    }
+#ifdef SET_SIMD
+    if constexpr (is_same<T, uint32_t>::value) {
+        if (na >= 4 && set_simd::level() != set_simd::Level::Scalar)
+            return set_simd::union_sse41(a, na, b, nb, out);
+    }
+#endif
+    size_t i = 0, j = 0, count = 0;
+    while (i < na && j < nb) {
+        if (a[i] < b[j])
+            out[count++] = a[i++];
+        else if (b[j] < a[i])
+            out[count++] = b[j++];
+        else {
+            out[count++] = a[i++];
+            j++;
+        }
+    }
+    copy(a + i, a + na, out + count);
+    count += na - i;
+    copy(b + j, b + nb, out + count);
+    return count + (nb - j);
+}
+
+template <class T>
+size_t set_difference_simd(const T* a, size_t na, const T* b, size_t nb, T* out) {
+    size_t i = 0, j = 0, count = 0;
+    if (nb * 32 < na) {
+        for (; j < nb; j++) {
+            size_t next = set_simd::gallop(a, i, na, b[j]);
+            copy(a + i, a + next, out + count);
+            count += next - i;
+            i = next < na && a[next] == b[j] ? next + 1 : next;
+        }
+        copy(a + i, a + na, out + count);
+        return count + (na - i);
+    }
+    if (na * 32 < nb) {
+        for (; i < na; i++) {
+            j = set_simd::gallop(b, j, nb, a[i]);
+            if (j == nb || b[j] != a[i])
+                out[count++] = a[i];
+        }
+        return count;
+    }
+#ifdef SET_SIMD
+    if constexpr (set_simd::HasKernel<T>::value) {
+        if (set_simd::level() == set_simd::Level::AVX2)
+            count = set_simd::difference_avx2(a, na, b, nb, out, i, j);
+        else if (set_simd::level() == set_simd::Level::SSE41)
+            count = set_simd::difference_sse41(a, na, b, nb, out, i, j);
+    }
+#endif
+    while (i < na && j < nb) {
+        if (a[i] < b[j])
+            out[count++] = a[i++];
+        else if (b[j] < a[i])
+            j++;
+        else {
+            i++;
+            j++;
+        }
+    }
+    copy(a + i, a + na, out + count);
+    return count + (na - i);
+}
+
+// vector versions return a vector of the exact size
+template <class T>
+vector<T> set_intersection_simd(const vector<T>& a, const vector<T>& b) {
+    vector<T> out(min(a.size(), b.size()));
+    out.resize(set_intersection_simd(a.data(), a.size(), b.data(), b.size(), out.data()));
+    return out;
+}
+
+template <class T>
+vector<T> set_union_simd(const vector<T>& a, const vector<T>& b) {
+    vector<T> out(a.size() + b.size());
+    out.resize(set_union_simd(a.data(), a.size(), b.data(), b.size(), out.data()));
+    return out;
+}
+
+template <class T>
+vector<T> set_difference_simd(const vector<T>& a, const vector<T>& b) {
+    vector<T> out(a.size());
+    out.resize(set_difference_simd(a.data(), a.size(), b.data(), b.size(), out.data()));
+    return out;
+}
+
+vector<int> random_vector(size_t size, unsigned seed) {
+    vector<int> v(size);
+    mt19937 random(seed);
+    for (auto& value : v)
+        value = (int)random();
+    return v;
+}
+
+void test_parallel_algorithms() {
+    print("test_parallel_algorithms - begin");
+
+    // every parallel algorithm is compared with the STL one on the same random data
+    int threads = 4;
+    vector<int> data = random_vector(1000000, 1);
+    vector<int> expected = data;
+    sort(expected.begin(), expected.end());
+
+    print_title("parallel_merge_sort");
+    vector<int> v = data;
+    parallel_merge_sort(v.begin(), v.end(), threads);
+    cout << "same as sort = " << (v == expected) << endl;
+
+    // stability: sort pairs by the first value only, the second value shows the original order
+    vector<pair<int, int>> pairs;
+    for (int i = 0; i < 100000; i++)
+        pairs.push_back({data[i] % 100, i});
+    vector<pair<int, int>> stable = pairs;
+    auto by_first = [](const pair<int, int>& a, const pair<int, int>& b) { return a.first < b.first; };
+    stable_sort(stable.begin(), stable.end(), by_first);
+    parallel_merge_sort(pairs.begin(), pairs.end(), threads, by_first);
+    cout << "same as stable_sort = " << (pairs == stable) << endl;
+
+    print_title("parallel_radix_sort");
+    v = data;
+    parallel_radix_sort(v, threads);
+    cout << "same as sort = " << (v == expected) << endl;
+
+    // empty and single element inputs
+    vector<int> small;
+    parallel_radix_sort(small, threads);
+    parallel_merge_sort(small.begin(), small.end(), threads);
+    small.push_back(7);
+    parallel_radix_sort(small, threads);
+    parallel_merge_sort(small.begin(), small.end(), threads);
+    cout << "empty and one element = " << (small == vector<int>{7}) << endl;
+
+    print_title("parallel_nth_element");
+    v = data;
+    size_t nth = v.size() / 3;
+    parallel_nth_element(v.begin(), v.begin() + nth, v.end(), threads);
+    bool ok = v[nth] == expected[nth];
+    for (size_t i = 0; i < v.size(); i++)
+        ok &= i < nth ? v[i] <= v[nth] : v[i] >= v[nth];
+    cout << "nth element = " << v[nth] << ", correct = " << ok << endl;
+
+    print_title("parallel_partial_sort");
+    v = data;
+    parallel_partial_sort(v.begin(), v.begin() + 1000, v.end(), threads);
+    cout << "same as partial_sort = " << equal(v.begin(), v.begin() + 1000, expected.begin()) << endl;
+}
+
+void test_search_index() {
+    print("test_search_index - begin");
+
+    // sorted values with many duplicates, every answer is compared with the STL one
+    vector<int> sorted = random_vector(100000, 3);
+    for (auto& value : sorted)
+        value %= 20000;
+    sort(sorted.begin(), sorted.end());
+    EytzingerIndex<int> eytzinger(sorted);
+    STreeIndex stree(sorted);
+
+    vector<int> queries = random_vector(100000, 4);
+    for (auto& value : queries)
+        value %= 25000;
+    queries.push_back(INT_MIN);
+    queries.push_back(INT_MAX);
+    vector<size_t> eytzinger_batch(queries.size()), stree_batch(queries.size());
+    eytzinger.lower_bound(queries.data(), queries.size(), eytzinger_batch.data());
+    stree.lower_bound(queries.data(), queries.size(), stree_batch.data());
+
+    size_t errors = 0;
+    for (size_t i = 0; i < queries.size(); i++) {
+        int q = queries[i];
+        size_t lower = std::lower_bound(sorted.begin(), sorted.end(), q) - sorted.begin();
+        size_t upper = std::upper_bound(sorted.begin(), sorted.end(), q) - sorted.begin();
+        bool found = std::binary_search(sorted.begin(), sorted.end(), q);
+        errors += eytzinger.lower_bound(q) != lower || eytzinger.upper_bound(q) != upper ||
+                  eytzinger.binary_search(q) != found || eytzinger_batch[i] != lower;
+        errors += stree.lower_bound(q) != lower || stree.upper_bound(q) != upper ||
+                  stree.binary_search(q) != found || stree_batch[i] != lower;
+        errors += eytzinger.equal_range(q) != make_pair(lower, upper) || stree.equal_range(q) != make_pair(lower, upper);
+    }
+    print_title("EytzingerIndex / STreeIndex");
+    cout << queries.size() << " queries, errors = " << errors << endl;
+}
+
+// sorted unique values: size values from [0, range), plus the biggest value when with_max is set
+template <class T>
+vector<T> random_set(size_t size, T range, bool with_max, mt19937_64& random) {
+    vector<T> v(size);
+    for (auto& value : v)
+        value = (T)(random() % range);
+    if (with_max && size)
+        v[0] = numeric_limits<T>::max();
+    sort(v.begin(), v.end());
+    v.erase(unique(v.begin(), v.end()), v.end());
+    return v;
+}
+
+template <class T>
+size_t check_set_operations(mt19937_64& random) {
+    size_t errors = 0;
+    const size_t sizes[] = {0, 1, 3, 7, 8, 9, 31, 100, 1000, 50000};
+    for (size_t na : sizes)
+        for (size_t nb : sizes)
+            for (T range : {T(16), T(1000), T(100000), T(~T(0) - 1)}) {
+                vector<T> a = random_set<T>(na, range, random() % 2, random);
+                vector<T> b = random_set<T>(nb, range, random() % 2, random);
+                vector<T> expected;
+                set_intersection(a.begin(), a.end(), b.begin(), b.end(), back_inserter(expected));
+                errors += set_intersection_simd(a, b) != expected;
+                expected.clear();
+                set_union(a.begin(), a.end(), b.begin(), b.end(), back_inserter(expected));
+                errors += set_union_simd(a, b) != expected;
+                expected.clear();
+                set_difference(a.begin(), a.end(), b.begin(), b.end(), back_inserter(expected));
+                errors += set_difference_simd(a, b) != expected;
+            }
+    return errors;
+}
+
+void test_set_operations() {
+    print("test_set_operations - begin");
+    print_title("set_intersection_simd / set_union_simd / set_difference_simd");
+    mt19937_64 random(7);
+    cout << "uint32_t errors = " << check_set_operations<uint32_t>(random) << endl;
+    cout << "uint64_t errors = " << check_set_operations<uint64_t>(random) << endl;
+}
+
+// time of one call in milliseconds
+template <class F>
+double measure(F f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// compares the parallel algorithms with the sequential STL calls from test_algorithms
+void benchmark_parallel_algorithms(size_t size, int threads) {
+    print_title("benchmark");
+    cout << size << " elements, " << threads << " threads" << endl;
+    const vector<int> data = random_vector(size, 2);
+    vector<int> v;
+    size_t middle = size / 100;
+
+    auto row = [](const char* name, double stl, double parallel) {
+        cout << name << ": STL " << stl << " ms, parallel " << parallel << " ms, x" << stl / parallel << endl;
+    };
+
+    v = data;
+    double stl = measure([&] { sort(v.begin(), v.end()); });
+    v = data;
+    row("sort / parallel_merge_sort", stl, measure([&] { parallel_merge_sort(v.begin(), v.end(), threads); }));
+    v = data;
+    row("sort / parallel_radix_sort", stl, measure([&] { parallel_radix_sort(v, threads); }));
+
+    v = data;
+    stl = measure([&] { stable_sort(v.begin(), v.end()); });
+    v = data;
+    row("stable_sort / parallel_merge_sort", stl, measure([&] { parallel_merge_sort(v.begin(), v.end(), threads); }));
+
+    v = data;
+    stl = measure([&] { nth_element(v.begin(), v.begin() + size / 2, v.end()); });
+    v = data;
+    row("nth_element / parallel_nth_element", stl,
+        measure([&] { parallel_nth_element(v.begin(), v.begin() + size / 2, v.end(), threads); }));
+
+    v = data;
+    stl = measure([&] { partial_sort(v.begin(), v.begin() + middle, v.end()); });
+    v = data;
+    row("partial_sort / parallel_partial_sort", stl,
+        measure([&] { parallel_partial_sort(v.begin(), v.begin() + middle, v.end(), threads); }));
+
+#ifdef STL_PARALLEL_EXECUTION
+    v = data;
+    stl = measure([&] { sort(v.begin(), v.end()); });
+    v = data;
+    row("sort / sort(execution::par)", stl, measure([&] { sort(execution::par, v.begin(), v.end()); }));
+#endif
+}
+
+// lower_bound in nanoseconds per query, from arrays that fit into L1 cache up to max_size elements
+void benchmark_search(size_t max_size) {
+    print_title("search benchmark (ns per lower_bound)");
+    const size_t query_count = 1 << 20;
+    vector<int> queries = random_vector(query_count, 5);
+    vector<size_t> results(query_count);
+    for (size_t size = 1024; size <= max_size; size *= 4) {
+        vector<int> sorted = random_vector(size, 6);
+        sort(sorted.begin(), sorted.end());
+        EytzingerIndex<int> eytzinger(sorted);
+        STreeIndex stree(sorted);
+
+        size_t check = 0;
+        double stl = measure([&] {
+            for (size_t i = 0; i < query_count; i++)
+                check += std::lower_bound(sorted.begin(), sorted.end(), queries[i]) - sorted.begin();
+        });
+        double eytzinger_time = measure([&] {
+            for (size_t i = 0; i < query_count; i++)
+                check -= eytzinger.lower_bound(queries[i]);
+        });
+        double eytzinger_batch = measure([&] { eytzinger.lower_bound(queries.data(), query_count, results.data()); });
+        double stree_time = measure([&] {
+            for (size_t i = 0; i < query_count; i++)
+                check += stree.lower_bound(queries[i]);
+        });
+        for (size_t i = 0; i < query_count; i++)
+            check -= results[i];
+        double stree_batch = measure([&] { stree.lower_bound(queries.data(), query_count, results.data()); });
+
+        double to_ns = 1e6 / query_count;
+        cout << size * sizeof(int) / 1024 << " KB: std::lower_bound " << stl * to_ns << ", eytzinger "
+             << eytzinger_time * to_ns << ", eytzinger batch " << eytzinger_batch * to_ns << ", s-tree "
+             << stree_time * to_ns << ", s-tree batch " << stree_batch * to_ns << (check ? " MISMATCH" : "") << endl;
+    }
+}
+
+// STL set operations against the SIMD ones, for equal sizes and for a 1000 times smaller second set
+void benchmark_set_operations() {
+    print_title("set operations benchmark (ms)");
+    mt19937_64 random(8);
+    for (size_t small : {(size_t)4000000, (size_t)4000}) {
+        vector<uint32_t> a = random_set<uint32_t>(4000000, 16000000, false, random);
+        vector<uint32_t> b = random_set<uint32_t>(small, 16000000, false, random);
+        vector<uint32_t> out(a.size() + b.size());
+        size_t stl_count = 0, simd_count = 0;
+        auto row = [&](const char* name, double stl, double simd) {
+            cout << a.size() << " x " << b.size() << " " << name << ": STL " << stl << ", SIMD " << simd
+                 << (stl_count == simd_count ? "" : " MISMATCH") << endl;
+        };
+
+        double stl = measure([&] { stl_count = set_intersection(a.begin(), a.end(), b.begin(), b.end(), out.begin()) - out.begin(); });
+        double simd = measure([&] { simd_count = set_intersection_simd(a.data(), a.size(), b.data(), b.size(), out.data()); });
+        row("intersection", stl, simd);
+        stl = measure([&] { stl_count = set_union(a.begin(), a.end(), b.begin(), b.end(), out.begin()) - out.begin(); });
+        simd = measure([&] { simd_count = set_union_simd(a.data(), a.size(), b.data(), b.size(), out.data()); });
+        row("union", stl, simd);
+        stl = measure([&] { stl_count = set_difference(a.begin(), a.end(), b.begin(), b.end(), out.begin()) - out.begin(); });
+        simd = measure([&] { simd_count = set_difference_simd(a.data(), a.size(), b.data(), b.size(), out.data()); });
+        row("difference", stl, simd);
+    }
+}
+
+// "bench [size] [threads]" runs the sorting benchmark, e.g. bench 100000000 8
+// "search [max size]" runs the search benchmark, e.g. search 1000000000 (4 GB of keys)
+int main(int argc, char** argv) {
     test_algorithms();
+    test_parallel_algorithms();
+    test_search_index();
+    test_set_operations();
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        size_t size = argc > 2 ? strtoull(argv[2], nullptr, 10) : 10000000;
+        int threads = argc > 3 ? atoi(argv[3]) : default_threads();
+        benchmark_parallel_algorithms(size, threads);
+        benchmark_set_operations();
+    }
+    if (argc > 1 && strcmp(argv[1], "search") == 0)
+        benchmark_search(argc > 2 ? strtoull(argv[2], nullptr, 10) : 1 << 24);
     return 0;
 }
+